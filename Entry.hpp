@@ -6,8 +6,20 @@
 #include <fstream>
 #include <vector>
 #include <array>
+#include <limits>
+#include <string>
+#include <cstring>
+#include <cmath>
+#include <algorithm>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "MappedFile.hpp"
 
 struct Entry {
+  Entry() : gid(0), c_prob(0.0), h({0.0, 0.0, 0.0}) {};
   Entry(uint64_t _gid, double _c_prob, double h0, double h1, double h2) : gid(_gid), c_prob(_c_prob), h({h0,h1,h2}) {};
   uint64_t gid;
   double c_prob;
@@ -22,28 +34,311 @@ struct Entry {
   bool operator==(const Entry& rhs) const {
     return gid == rhs.gid;
   }
-  static std::vector<Entry> Load(const char* fname) {
-    std::ifstream fin(fname);
-    if (!fin) {
+  // load the ESS_ids file in the text format, the binary format of EntryFile, or the manifest of the shards
+  static std::vector<Entry> Load(const char* fname);
+  // The text is mapped and split into chunks at newlines, which are parsed in parallel without iostreams.
+  // The columns after the fifth one, such as the benefit range, are skipped. Blank lines are skipped as well.
+  // Malformed lines are reported with their line numbers and an exception is thrown.
+  static std::vector<Entry> LoadText(const char* fname) {
+    if (!std::ifstream(fname)) {
       std::cerr << "Failed to open file: " << fname << std::endl;
       throw std::runtime_error("failed to open file");
     }
+    const MappedFile file(fname);
+    const char* const begin = file.Data();
+    const char* const end = begin + file.Size();
+
+    int num_chunks = 1;
+    #ifdef _OPENMP
+    num_chunks = omp_get_max_threads();
+    #endif
+    std::vector<const char*> bounds(num_chunks + 1, end);
+    bounds[0] = begin;
+    for (int c = 1; c < num_chunks; c++) {
+      const char* p = begin + file.Size() / num_chunks * c;
+      if (p < bounds[c-1]) { p = bounds[c-1]; }
+      while (p > begin && p < end && *(p-1) != '\n') { p++; }
+      bounds[c] = p;
+    }
+
+    std::vector<std::vector<Entry>> entries(num_chunks);
+    std::vector<size_t> num_lines(num_chunks, 0);
+    std::vector<std::vector<size_t>> bad_lines(num_chunks);  // line numbers in the chunk
+    #pragma omp parallel for schedule(static, 1)
+    for (int c = 0; c < num_chunks; c++) {
+      entries[c].reserve((bounds[c+1] - bounds[c]) / 48);
+      const char* p = bounds[c];
+      while (p < bounds[c+1]) {
+        const char* eol = static_cast<const char*>(std::memchr(p, '\n', bounds[c+1] - p));
+        if (!eol) { eol = bounds[c+1]; }
+        Entry e;
+        const int r = ParseLine(p, eol, e);
+        if (r > 0) { entries[c].push_back(e); }
+        else if (r < 0) { bad_lines[c].push_back(num_lines[c]); }
+        num_lines[c]++;
+        p = eol + 1;
+      }
+    }
+
+    size_t line_offset = 0, num_bad = 0;
+    for (int c = 0; c < num_chunks; c++) {
+      for (size_t l: bad_lines[c]) {
+        if (num_bad++ < 10) { std::cerr << fname << ":" << line_offset + l + 1 << ": malformed line" << std::endl; }
+      }
+      line_offset += num_lines[c];
+    }
+    if (num_bad > 0) {
+      std::cerr << num_bad << " malformed lines in " << fname << std::endl;
+      throw std::runtime_error("malformed ESS_ids file");
+    }
+
+    std::vector<Entry> v;
+    if (num_chunks == 1) { v.swap(entries[0]); return v; }
+    size_t total = 0;
+    for (const auto& e: entries) { total += e.size(); }
+    v.reserve(total);
+    for (const auto& e: entries) { v.insert(v.end(), e.begin(), e.end()); }
+    return v;
+  }
+  // parse a line [p, eol) of the text format. Returns 1 when an entry is parsed, 0 for a blank line, and -1 for a malformed line.
+  static int ParseLine(const char* p, const char* eol, Entry& e) {
+    p = SkipSpaces(p, eol);
+    if (p == eol) { return 0; }
+    bool ok = ParseUInt64(p, eol, e.gid) && ParseDouble(p, eol, e.c_prob);
+    for (int i = 0; ok && i < 3; i++) { ok = ParseDouble(p, eol, e.h[i]); }
+    return ok ? 1 : -1;
+  }
+  // load the binary shards listed in the manifest written by main_search_ESS. The paths of the shards are relative to the manifest.
+  // Each record starts with gid, c_prob, and h as uint64_t and doubles. The following columns such as the benefit range are skipped.
+  static std::vector<Entry> LoadShards(const char* manifest_path) {
+    size_t record_size = 0, total = 0;
+    const auto shards = ManifestShards(manifest_path, record_size, total);
     std::vector<Entry> v;
-    while (fin) {
-      uint64_t gid;
-      double c_prob, h0, h1, h2;
-      fin >> gid >> c_prob >> h0 >> h1 >> h2;
-      v.emplace_back(gid, c_prob, h0, h1, h2);
+    v.reserve(total);
+    for (const auto& shard: shards) {
+      MappedFile file(shard.first);
+      if (file.Size() < shard.second * record_size) {
+        std::cerr << "Failed to read shard: " << shard.first << std::endl;
+        throw std::runtime_error("failed to read shard");
+      }
+      for (size_t i = 0; i < shard.second; i++) { v.push_back(FromRecord(file.Data() + i * record_size)); }
     }
     return v;
   }
-  static std::vector<Entry> LoadAndUniqSort(const char* fname) {
-    auto v = Load(fname);
-    std::sort(v.begin(), v.end());
-    auto it = std::unique(v.begin(), v.end());
-    v.erase(it, v.end());
+  // paths and numbers of records of the shards listed in the manifest
+  static std::vector<std::pair<std::string,size_t>> ManifestShards(const char* manifest_path, size_t& record_size, size_t& total) {
+    std::ifstream fin(manifest_path);
+    const nlohmann::json manifest = nlohmann::json::parse(fin);
+    if (manifest.at("format").get<std::string>() != "ESS_shards") { throw std::runtime_error("unknown format of the manifest"); }
+    record_size = manifest.at("record_size").get<size_t>();
+    if (record_size < 5 * sizeof(double)) { throw std::runtime_error("invalid record size"); }
+    total = manifest.at("num_records").get<size_t>();
+    const std::string path(manifest_path);
+    const std::string dir = (path.find('/') == std::string::npos) ? "" : path.substr(0, path.rfind('/') + 1);
+    std::vector<std::pair<std::string,size_t>> shards;
+    for (const auto& shard: manifest.at("shards")) {
+      shards.emplace_back(dir + shard.at("path").get<std::string>(), shard.at("num_records").get<size_t>());
+    }
+    return shards;
+  }
+  static Entry FromRecord(const char* p) {
+    Entry e;
+    std::memcpy(&e.gid, p, sizeof(uint64_t));
+    std::memcpy(&e.c_prob, p + sizeof(uint64_t), sizeof(double));
+    std::memcpy(e.h.data(), p + sizeof(uint64_t) + sizeof(double), 3 * sizeof(double));
+    return e;
+  }
+  static std::vector<Entry> LoadAndUniqSort(const char* fname);
+
+  private:
+  static const char* SkipSpaces(const char* p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r')) { p++; }
+    return p;
+  }
+  // Parse a field separated by spaces and advance p to the end of it. Return false unless the whole field is a number.
+  static bool ParseUInt64(const char*& p, const char* end, uint64_t& out) {
+    p = SkipSpaces(p, end);
+    const char* q = p;
+    uint64_t x = 0;
+    while (q < end && *q >= '0' && *q <= '9') {
+      const uint64_t digit = static_cast<uint64_t>(*q - '0');
+      if (x > (std::numeric_limits<uint64_t>::max() - digit) / 10) { return false; }
+      x = x * 10 + digit;
+      q++;
+    }
+    if (q == p || (q < end && *q != ' ' && *q != '\t' && *q != '\r')) { return false; }
+    out = x;
+    p = q;
+    return true;
+  }
+  // Decimals of up to 15 significant digits and 10^22 are converted exactly as a single multiplication or division of exact values,
+  // which is correctly rounded. The others, such as "1.79769e+308" or "nan", are converted by strtod.
+  static bool ParseDouble(const char*& p, const char* end, double& out) {
+    p = SkipSpaces(p, end);
+    const char* q = p;
+    while (q < end && *q != ' ' && *q != '\t' && *q != '\r') { q++; }
+    if (q == p) { return false; }
+    const char* r = p;
+    const bool negative = (*r == '-');
+    if (*r == '-' || *r == '+') { r++; }
+    uint64_t mantissa = 0;
+    int num_digits = 0, exp10 = 0;
+    bool has_digit = false;
+    for (; r < q && *r >= '0' && *r <= '9'; r++) {
+      has_digit = true;
+      if (mantissa == 0 && *r == '0') { continue; }
+      if (++num_digits <= 19) { mantissa = mantissa * 10 + (*r - '0'); } else { exp10++; }
+    }
+    if (r < q && *r == '.') {
+      for (r++; r < q && *r >= '0' && *r <= '9'; r++) {
+        has_digit = true;
+        if (mantissa == 0 && *r == '0') { exp10--; continue; }
+        if (++num_digits <= 19) { mantissa = mantissa * 10 + (*r - '0'); exp10--; }
+      }
+    }
+    if (has_digit && r < q && (*r == 'e' || *r == 'E')) {
+      const char* e = r + 1;
+      const bool e_negative = (e < q && *e == '-');
+      if (e < q && (*e == '-' || *e == '+')) { e++; }
+      int x = 0;
+      const char* e_digits = e;
+      for (; e < q && *e >= '0' && *e <= '9' && x < 10000; e++) { x = x * 10 + (*e - '0'); }
+      if (e == e_digits) { return false; }
+      exp10 += e_negative ? -x : x;
+      r = e;
+    }
+    static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+    if (has_digit && r == q && num_digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+      double x = static_cast<double>(mantissa);
+      x = (exp10 < 0) ? x / pow10[-exp10] : x * pow10[exp10];
+      out = negative ? -x : x;
+      p = q;
+      return true;
+    }
+    // fall back to strtod, which requires a null-terminated string
+    std::string token(p, q);
+    char* parsed_end = nullptr;
+    out = std::strtod(token.c_str(), &parsed_end);
+    if (parsed_end != token.c_str() + token.size()) { return false; }
+    p = q;
+    return true;
+  }
+};
+
+// Binary columnar format of the ESS_ids, which is memory-mapped so that the columns are read without parsing or copying.
+// The file consists of the 64-byte header followed by the columns of gid (uint64_t), c_prob, h_B, h_N, and h_G (double) in the native byte order.
+// When the sorted flag is set, the entries are sorted by gid without duplicates.
+class EntryFile {
+  public:
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t flags;   // bit 0: sorted
+    uint64_t num_entries;
+    double mu_e, mu_a, benefit;  // NaN when unknown
+    uint64_t reserved[2];
+  };
+  static_assert(sizeof(Header) == 64, "the header must be 64 bytes so that the columns are aligned");
+  static constexpr uint32_t Version = 1;
+
+  explicit EntryFile(const std::string& path) : file(path) {
+    if (file.Size() < sizeof(Header) || !HasMagic(file.Data())) { throw std::runtime_error("not an ESS binary file: " + path); }
+    std::memcpy(&header, file.Data(), sizeof(Header));
+    if (header.version != Version) { throw std::runtime_error("unsupported version of ESS binary file: " + path); }
+    if (file.Size() != sizeof(Header) + header.num_entries * 5 * sizeof(double)) { throw std::runtime_error("ESS binary file is truncated: " + path); }
+  }
+  size_t Size() const { return header.num_entries; }
+  bool IsSorted() const { return (header.flags & 1u) != 0; }
+  double MuE() const { return header.mu_e; }
+  double MuA() const { return header.mu_a; }
+  double Benefit() const { return header.benefit; }
+  ConstSpan<uint64_t> Gids() const { return ConstSpan<uint64_t>(reinterpret_cast<const uint64_t*>(Column(0)), Size()); }
+  ConstSpan<double> CProbs() const { return ConstSpan<double>(reinterpret_cast<const double*>(Column(1)), Size()); }
+  // fraction of reputation i (0:B, 1:N, 2:G)
+  ConstSpan<double> H(int i) const { return ConstSpan<double>(reinterpret_cast<const double*>(Column(2 + i)), Size()); }
+  Entry At(size_t i) const { return Entry(Gids()[i], CProbs()[i], H(0)[i], H(1)[i], H(2)[i]); }
+  // drop the pages of the entries [first, last) from the memory. See MappedFile::Release.
+  void Release(size_t first, size_t last) const {
+    for (int c = 0; c < 5; c++) {
+      const size_t offset = Column(c) - file.Data();
+      file.Release(offset + first * sizeof(double), offset + last * sizeof(double));
+    }
+  }
+  std::vector<Entry> ToEntries() const {
+    std::vector<Entry> v;
+    v.reserve(Size());
+    for (size_t i = 0; i < Size(); i++) { v.emplace_back(At(i)); }
     return v;
   }
+
+  static bool IsEntryFile(const char* path) {
+    std::ifstream fin(path, std::ios::binary);
+    char buf[8];
+    return fin.read(buf, sizeof(buf)) && HasMagic(buf);
+  }
+  static void Write(const char* path, const std::vector<Entry>& entries, bool sorted,
+                    double mu_e = NAN, double mu_a = NAN, double benefit = NAN) {
+    Write(path, entries.data(), entries.data() + entries.size(), sorted, mu_e, mu_a, benefit);
+  }
+  static void Write(const char* path, const Entry* first, const Entry* last, bool sorted,
+                    double mu_e = NAN, double mu_a = NAN, double benefit = NAN) {
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout) {
+      std::cerr << "Failed to open file: " << path << std::endl;
+      throw std::runtime_error("failed to open file");
+    }
+    Header h = {};
+    std::memcpy(h.magic, Magic(), sizeof(h.magic));
+    h.version = Version;
+    h.flags = sorted ? 1u : 0u;
+    h.num_entries = last - first;
+    h.mu_e = mu_e;
+    h.mu_a = mu_a;
+    h.benefit = benefit;
+    fout.write(reinterpret_cast<const char*>(&h), sizeof(h));
+    // the columns are written in blocks to keep the buffer small
+    const size_t block = 65536;
+    std::vector<char> buf(block * sizeof(double));
+    for (int c = 0; c < 5; c++) {
+      for (const Entry* b = first; b < last; b += std::min<size_t>(block, last - b)) {
+        const size_t n = std::min<size_t>(block, last - b);
+        for (size_t i = 0; i < n; i++) {
+          const Entry& e = b[i];
+          if (c == 0) { std::memcpy(&buf[i * 8], &e.gid, 8); }
+          else { std::memcpy(&buf[i * 8], (c == 1) ? &e.c_prob : &e.h[c-2], 8); }
+        }
+        fout.write(buf.data(), n * 8);
+      }
+    }
+    if (!fout) { throw std::runtime_error("failed to write ESS binary file"); }
+  }
+
+  private:
+  MappedFile file;
+  Header header;
+  static const char* Magic() { return "ESSBIN\0\0"; }
+  static bool HasMagic(const char* p) { return std::memcmp(p, Magic(), 8) == 0; }
+  const char* Column(int c) const { return file.Data() + sizeof(Header) + c * Size() * sizeof(double); }
 };
 
+inline std::vector<Entry> Entry::Load(const char* fname) {
+  if (EntryFile::IsEntryFile(fname)) { return EntryFile(fname).ToEntries(); }
+  std::ifstream fin(fname);
+  if (fin && (fin >> std::ws).peek() == '{') { return LoadShards(fname); }
+  return LoadText(fname);
+}
+
+inline std::vector<Entry> Entry::LoadAndUniqSort(const char* fname) {
+  if (EntryFile::IsEntryFile(fname)) {
+    EntryFile f(fname);
+    if (f.IsSorted()) { return f.ToEntries(); }
+  }
+  auto v = Load(fname);
+  std::sort(v.begin(), v.end());
+  auto it = std::unique(v.begin(), v.end());
+  v.erase(it, v.end());
+  return v;
+}
+
 #endif  // ENTRY_HPP
@@ -0,0 +1,209 @@
+#ifndef ENTRY_STREAM_HPP
+#define ENTRY_STREAM_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <memory>
+#include <queue>
+#include <functional>
+#include "Entry.hpp"
+
+
+// Sequential reader of an ESS_ids file in any format accepted by Entry::Load.
+// The file is mapped and read entry by entry. The pages already read are released, so the memory usage does not depend on the size of the file.
+class EntryReader {
+  public:
+  explicit EntryReader(const std::string& _path) : path(_path) {
+    if (EntryFile::IsEntryFile(path.c_str())) {
+      binary.reset(new EntryFile(path));
+      return;
+    }
+    std::ifstream fin(path);
+    if (!fin) {
+      std::cerr << "Failed to open file: " << path << std::endl;
+      throw std::runtime_error("failed to open file");
+    }
+    if ((fin >> std::ws).peek() == '{') {
+      size_t total = 0;
+      shards = Entry::ManifestShards(path.c_str(), record_size, total);
+      return;
+    }
+    file.reset(new MappedFile(path));
+    file->AdviseSequential();
+    cur = released = file->Data();
+    end = cur + file->Size();
+  }
+  // reader of the entries already loaded in memory. The vector must outlive the reader.
+  EntryReader(const std::vector<Entry>& _entries, const std::string& name) : path(name), entries(&_entries) {};
+  const std::string& Path() const { return path; }
+  // read the next entry. Returns false at the end of the file.
+  bool Next(Entry& e) {
+    if (entries) {
+      if (index >= entries->size()) { return false; }
+      e = (*entries)[index++];
+      return true;
+    }
+    if (binary) {
+      if (index >= binary->Size()) { return false; }
+      if (index % ReleaseEntries == 0 && index > 0) { binary->Release(index - ReleaseEntries, index); }
+      e = binary->At(index++);
+      return true;
+    }
+    if (file && shard_idx < shards.size()) { return NextInShard(e); }
+    if (!shards.empty()) { return OpenShard() && NextInShard(e); }
+    while (cur < end) {
+      if (cur - released > static_cast<ptrdiff_t>(ReleaseBytes)) {
+        file->Release(released - file->Data(), cur - file->Data());
+        released = cur;
+      }
+      const char* eol = static_cast<const char*>(std::memchr(cur, '\n', end - cur));
+      if (!eol) { eol = end; }
+      line++;
+      const int r = Entry::ParseLine(cur, eol, e);
+      cur = eol + 1;
+      if (r > 0) { return true; }
+      if (r < 0) {
+        std::cerr << path << ":" << line << ": malformed line" << std::endl;
+        throw std::runtime_error("malformed ESS_ids file");
+      }
+    }
+    return false;
+  }
+
+  private:
+  std::string path;
+  const std::vector<Entry>* entries = nullptr;
+  std::unique_ptr<EntryFile> binary;
+  std::unique_ptr<MappedFile> file;  // text or the current shard
+  const char* cur = nullptr;
+  const char* end = nullptr;
+  const char* released = nullptr;  // the pages before this are released
+  static constexpr size_t ReleaseBytes = 1ul << 20;
+  static constexpr size_t ReleaseEntries = 1ul << 14;
+  size_t index = 0, line = 0;
+  std::vector<std::pair<std::string,size_t>> shards;
+  size_t record_size = 0, shard_idx = 0;
+  // open the next non-empty shard
+  bool OpenShard() {
+    if (file) { shard_idx++; file.reset(); }
+    for (; shard_idx < shards.size(); shard_idx++) {
+      if (shards[shard_idx].second == 0) { continue; }
+      file.reset(new MappedFile(shards[shard_idx].first));
+      if (file->Size() < shards[shard_idx].second * record_size) {
+        std::cerr << "Failed to read shard: " << shards[shard_idx].first << std::endl;
+        throw std::runtime_error("failed to read shard");
+      }
+      file->AdviseSequential();
+      index = 0;
+      return true;
+    }
+    return false;
+  }
+  bool NextInShard(Entry& e) {
+    if (index == shards[shard_idx].second) { return OpenShard() && NextInShard(e); }
+    if (index % ReleaseEntries == 0 && index > 0) { file->Release((index - ReleaseEntries) * record_size, index * record_size); }
+    e = Entry::FromRecord(file->Data() + (index++) * record_size);
+    return true;
+  }
+};
+
+// Merges the readers of ESS_ids files sorted by gid in a single pass.
+// Each gid is yielded once in the ascending order together with the list of the inputs containing it.
+// The entry is taken from the first of those inputs. Duplicates in an input are skipped, and an unsorted input raises an exception.
+class EntryMerger {
+  public:
+  explicit EntryMerger(std::vector<std::unique_ptr<EntryReader>>&& _readers) : readers(std::move(_readers)), heads(readers.size()) {
+    for (size_t i = 0; i < readers.size(); i++) {
+      if (readers[i]->Next(heads[i])) { heap.emplace(heads[i].gid, i); }
+    }
+  }
+  size_t NumInputs() const { return readers.size(); }
+  // the next gid and the indexes of the inputs containing it in the ascending order. Returns false when all the inputs are exhausted.
+  bool Next(Entry& e, std::vector<size_t>& inputs) {
+    inputs.clear();
+    if (heap.empty()) { return false; }
+    const uint64_t gid = heap.top().first;
+    e = heads[heap.top().second];
+    while (!heap.empty() && heap.top().first == gid) {
+      inputs.push_back(heap.top().second);
+      heap.pop();
+    }
+    for (size_t i: inputs) { Advance(i); }
+    return true;
+  }
+
+  private:
+  std::vector<std::unique_ptr<EntryReader>> readers;
+  std::vector<Entry> heads;  // the current entry of each reader
+  using item_t = std::pair<uint64_t,size_t>;  // gid and the index of the reader
+  std::priority_queue<item_t, std::vector<item_t>, std::greater<item_t>> heap;
+  void Advance(size_t i) {
+    const uint64_t prev = heads[i].gid;
+    while (readers[i]->Next(heads[i])) {
+      if (heads[i].gid == prev) { continue; }
+      if (heads[i].gid < prev) {
+        std::cerr << readers[i]->Path() << " is not sorted at gid " << heads[i].gid << std::endl;
+        throw std::runtime_error("input is not sorted");
+      }
+      heap.emplace(heads[i].gid, i);
+      return;
+    }
+  }
+};
+
+// Statistics of the membership of the gids in the inputs, which are collected while merging them
+struct MembershipCounts {
+  explicit MembershipCounts(size_t num_inputs) : per_input(num_inputs, 0), only_in(num_inputs, 0), multiplicity(num_inputs + 1, 0) {};
+  std::vector<uint64_t> per_input;     // number of gids in each input
+  std::vector<uint64_t> only_in;       // number of gids found only in each input
+  std::vector<uint64_t> multiplicity;  // multiplicity[m] is the number of gids found in exactly m inputs
+  void Add(const std::vector<size_t>& inputs) {
+    for (size_t i: inputs) { per_input[i]++; }
+    if (inputs.size() == 1) { only_in[inputs[0]]++; }
+    multiplicity[inputs.size()]++;
+  }
+  void Print(std::ostream& os, const std::vector<std::string>& names) const {
+    for (size_t i = 0; i < per_input.size(); i++) {
+      os << names[i] << ": " << per_input[i] << " (only in this file: " << only_in[i] << ")" << std::endl;
+    }
+    for (size_t m = 1; m < multiplicity.size(); m++) {
+      os << "found in " << m << " files: " << multiplicity[m] << std::endl;
+    }
+  }
+};
+
+// Set operations over ESS_ids files, such as union, intersection, difference, and "found in at least k files", in a single merge pass.
+// When the inputs are sorted by gid, they are streamed from the files with a constant amount of memory.
+// Otherwise, each of them is loaded and sorted in memory except for the binary files having the sorted flag.
+class SortedEntrySets {
+  public:
+  SortedEntrySets(const std::vector<std::string>& _paths, bool presorted) : paths(_paths), loaded(_paths.size()) {
+    for (size_t i = 0; i < paths.size(); i++) {
+      const bool sorted_binary = EntryFile::IsEntryFile(paths[i].c_str()) && EntryFile(paths[i]).IsSorted();
+      if (!presorted && !sorted_binary) { loaded[i].reset(new std::vector<Entry>(Entry::LoadAndUniqSort(paths[i].c_str()))); }
+    }
+  }
+  const std::vector<std::string>& Paths() const { return paths; }
+  // call f for each gid with the indexes of the inputs containing it. The membership counts are accumulated in counts if given.
+  void Merge(const std::function<void(const Entry&, const std::vector<size_t>&)>& f, MembershipCounts* counts = nullptr) const {
+    std::vector<std::unique_ptr<EntryReader>> readers;
+    for (size_t i = 0; i < paths.size(); i++) {
+      if (loaded[i]) { readers.emplace_back(new EntryReader(*loaded[i], paths[i])); }
+      else { readers.emplace_back(new EntryReader(paths[i])); }
+    }
+    EntryMerger merger(std::move(readers));
+    Entry e;
+    std::vector<size_t> inputs;
+    while (merger.Next(e, inputs)) {
+      if (counts) { counts->Add(inputs); }
+      f(e, inputs);
+    }
+  }
+
+  private:
+  std::vector<std::string> paths;
+  std::vector<std::unique_ptr<std::vector<Entry>>> loaded;
+};
+
+#endif  // ENTRY_STREAM_HPP
@@ -0,0 +1,138 @@
+#ifndef ERROR_RATE_CONTINUATION_HPP
+#define ERROR_RATE_CONTINUATION_HPP
+
+#include <vector>
+#include <array>
+#include <cmath>
+#include "Game.hpp"
+
+
+// equilibria of a norm along a series of error rates, e.g., for the scaling of h* against mu.
+// The resident h* at the first error rates is found as usual from the uniform distribution and is refined by Newton's method.
+// At the following error rates, the branch of the fixed point is continued by Newton's method starting from the previous h*.
+// When Newton's method fails or jumps farther than max_distance, the step is bisected in the log scale of the error rates.
+// After max_bisections, h* is calculated from the uniform distribution as usual.
+class ErrorRateContinuation {
+  public:
+  using v3d_t = Game::v3d_t;
+  using mu_t = std::array<double,2>;  // (mu_e, mu_a)
+  struct Point {
+    double mu_e, mu_a;
+    double coop_prob;
+    v3d_t h_star;
+    bool continued;  // false when h* is calculated from the uniform distribution
+  };
+  explicit ErrorRateContinuation(uint64_t _game_id) : game_id(_game_id) {};
+  const uint64_t game_id;
+  size_t max_bisections = 8;
+  double max_distance = 0.05;
+
+  // error_rates should be in the descending order since h* is smoother for larger error rates
+  std::vector<Point> Solve(const std::vector<mu_t>& error_rates) const {
+    std::vector<Point> ans;
+    for (size_t i = 0; i < error_rates.size(); i++) {
+      ans.push_back( (i > 0) ? SolveFrom(ans.back(), error_rates[i]) : SolveAt(error_rates[i]) );
+    }
+    return ans;
+  }
+  // h* calculated from the uniform distribution
+  Point SolveAt(const mu_t& mu) const {
+    Game g(mu[0], mu[1], game_id);
+    Game g_newton(mu[0], mu[1], game_id);
+    const Game& g_ans = g_newton.CalcHStarResidentByNewtonFrom(g.ResidentEqReputation()) ? g_newton : g;
+    return {mu[0], mu[1], g_ans.ResidentCoopProb(), g_ans.ResidentEqReputation(), false};
+  }
+  // h* continued from a point at other error rates
+  Point SolveFrom(const Point& from, const mu_t& mu) const {
+    Point p;
+    return Continue(from, mu, 0, p) ? p : SolveAt(mu);
+  }
+
+  // local scaling of h_B, h_N, h_G, and the defect level 1 - coop_prob against the error rates, when both of them are multiplied by the same factor
+  struct Scaling {
+    std::array<double,4> exponent;   // d log x / d log mu
+    std::array<double,4> curvature;  // d^2 log x / d (log mu)^2
+  };
+  // Differentiating ResidentFlux(h*) = F(h*, mu) = 0 twice gives J h*' = -F_mu and J h*'' = -(F_hh h*' h*' + 2 F_hmu h*' + F_mumu),
+  // where ' is d/d(log mu) and J is the Jacobian along the simplex. Thus, the scaling is found from the equilibrium at a single error rate.
+  // The exponents are not finite when J is singular or the defect level vanishes.
+  Scaling LocalScaling(const Point& p) const {
+    const Strategy s(game_id);
+    const TransitionTensor t(p.mu_e, p.mu_a, s.rd, s.ar);
+    const auto dcs = TransitionTensor::LogErrorRateDerivatives(p.mu_e, p.mu_a, s.rd, s.ar);
+    const std::array<double,27>& dc = dcs[0];
+    const std::array<double,27>& ddc = dcs[1];
+    const v3d_t& h = p.h_star;
+    double jac[3][3] = {{-1.0, 0.0, 0.0}, {0.0, -1.0, 0.0}, {0.0, 0.0, -1.0}};
+    v3d_t df = {0.0, 0.0, 0.0};
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) {
+          jac[k][i] += h[j] * t.c[9*i+3*j+k];
+          jac[k][j] += h[i] * t.c[9*i+3*j+k];
+          df[k] += h[i] * h[j] * dc[9*i+3*j+k];
+        }
+      }
+    }
+    // h_2 = 1 - h_0 - h_1 is eliminated as in Game::NewtonResident
+    const double a = jac[0][0] - jac[0][2], b = jac[0][1] - jac[0][2];
+    const double d = jac[1][0] - jac[1][2], e = jac[1][1] - jac[1][2];
+    const double det = a * e - b * d;
+    auto solve = [a,b,d,e,det](const v3d_t& rhs)->v3d_t {
+      const double x0 = -( e * rhs[0] - b * rhs[1]) / det;
+      const double x1 = -(-d * rhs[0] + a * rhs[1]) / det;
+      return {x0, x1, -x0 - x1};
+    };
+    const v3d_t dh = solve(df);
+    v3d_t ddf = {0.0, 0.0, 0.0};
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) {
+          ddf[k] += 2.0 * dh[i] * dh[j] * t.c[9*i+3*j+k] + 2.0 * (dh[i] * h[j] + h[i] * dh[j]) * dc[9*i+3*j+k] + h[i] * h[j] * ddc[9*i+3*j+k];
+        }
+      }
+    }
+    const v3d_t ddh = solve(ddf);
+    double d_coop = 0.0, dd_coop = 0.0;
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        if (s.ar.ActAt(static_cast<Reputation>(i), static_cast<Reputation>(j)) == Action::C) {
+          d_coop += dh[i] * h[j] + h[i] * dh[j];
+          dd_coop += ddh[i] * h[j] + 2.0 * dh[i] * dh[j] + h[i] * ddh[j];
+        }
+      }
+    }
+    // for x(mu) with x' = dx/d(log mu), d(log x)/d(log mu) = x'/x and d^2(log x)/d(log mu)^2 = x''/x - (x'/x)^2
+    Scaling ans;
+    const std::array<double,4> x = {h[0], h[1], h[2], 1.0 - p.coop_prob};
+    const std::array<double,4> dx = {dh[0], dh[1], dh[2], -d_coop};
+    const std::array<double,4> ddx = {ddh[0], ddh[1], ddh[2], -dd_coop};
+    for (int n = 0; n < 4; n++) {
+      ans.exponent[n] = dx[n] / x[n];
+      ans.curvature[n] = ddx[n] / x[n] - ans.exponent[n] * ans.exponent[n];
+    }
+    return ans;
+  }
+
+  private:
+  bool Continue(const Point& from, const mu_t& mu_to, size_t depth, Point& to) const {
+    Game g(mu_to[0], mu_to[1], game_id);
+    if (g.CalcHStarResidentByNewtonFrom(from.h_star)) {
+      const v3d_t h = g.ResidentEqReputation();
+      double dist = std::abs(h[0] - from.h_star[0]) + std::abs(h[1] - from.h_star[1]) + std::abs(h[2] - from.h_star[2]);
+      if (dist < max_distance) {
+        to = {mu_to[0], mu_to[1], g.ResidentCoopProb(), h, true};
+        return true;
+      }
+    }
+    if (depth >= max_bisections) { return false; }
+    const mu_t mu_mid = {Midpoint(from.mu_e, mu_to[0]), Midpoint(from.mu_a, mu_to[1])};
+    Point mid;
+    return Continue(from, mu_mid, depth + 1, mid) && Continue(mid, mu_to, depth + 1, to);
+  }
+  static double Midpoint(double mu1, double mu2) {  // geometric mean unless one of them is zero
+    return (mu1 > 0.0 && mu2 > 0.0) ? std::sqrt(mu1 * mu2) : 0.5 * (mu1 + mu2);
+  }
+};
+
+#endif // ERROR_RATE_CONTINUATION_HPP
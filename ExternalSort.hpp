@@ -0,0 +1,93 @@
+#ifndef EXTERNAL_SORT_HPP
+#define EXTERNAL_SORT_HPP
+
+#include <iostream>
+#include <vector>
+#include <string>
+#include <algorithm>
+#include <cstdio>
+#include <unistd.h>
+#include "Entry.hpp"
+#include "EntryStream.hpp"
+
+
+// Sorts the entries of ESS_ids files by gid and removes the duplicates using a bounded amount of memory.
+// The inputs are read in batches of memory_budget bytes. Each batch is split into pieces, which are sorted in parallel
+// and written to tmp_dir as sorted runs in the binary format of EntryFile. Then, the runs are merged by EntryMerger in a single pass.
+// When the inputs fit in a single batch, they are sorted in memory without writing the runs.
+class ExternalSortUniq {
+  public:
+  ExternalSortUniq(size_t memory_budget, const std::string& _tmp_dir) :
+    batch_size(std::max<size_t>(memory_budget / sizeof(Entry), 1)), tmp_dir(_tmp_dir) {};
+  ~ExternalSortUniq() { RemoveRuns(); }
+  ExternalSortUniq(const ExternalSortUniq&) = delete;
+  ExternalSortUniq& operator=(const ExternalSortUniq&) = delete;
+
+  // call f for each of the unique entries in the ascending order of gid
+  void Run(const std::vector<std::string>& inputs, const std::function<void(const Entry&)>& f) {
+    std::vector<Entry> buf;
+    buf.reserve(batch_size);
+    for (const std::string& in: inputs) {
+      EntryReader reader(in);
+      Entry e;
+      while (reader.Next(e)) {
+        buf.push_back(e);
+        if (buf.size() == batch_size) {
+          WriteRuns(buf);
+          buf.clear();
+        }
+      }
+    }
+    if (runs.empty()) {
+      std::sort(buf.begin(), buf.end());
+      buf.erase(std::unique(buf.begin(), buf.end()), buf.end());
+      for (const Entry& e: buf) { f(e); }
+      return;
+    }
+    WriteRuns(buf);
+    std::vector<Entry>().swap(buf);
+
+    std::cerr << "merging " << runs.size() << " runs" << std::endl;
+    std::vector<std::unique_ptr<EntryReader>> readers;
+    for (const std::string& run: runs) { readers.emplace_back(new EntryReader(run)); }
+    EntryMerger merger(std::move(readers));
+    Entry e;
+    std::vector<size_t> from;
+    while (merger.Next(e, from)) { f(e); }
+    RemoveRuns();
+  }
+
+  private:
+  const size_t batch_size;
+  const std::string tmp_dir;
+  std::vector<std::string> runs;
+  // the pieces of a batch are not smaller than this so that small batches do not produce many runs
+  static constexpr size_t MinPieceSize = 1ul << 16;
+
+  void WriteRuns(std::vector<Entry>& buf) {
+    if (buf.empty()) { return; }
+    int num_pieces = 1;
+    #ifdef _OPENMP
+    num_pieces = omp_get_max_threads();
+    #endif
+    num_pieces = static_cast<int>(std::max<size_t>(std::min<size_t>(num_pieces, buf.size() / MinPieceSize), 1));
+    const size_t first_run = runs.size();
+    for (int i = 0; i < num_pieces; i++) {
+      runs.push_back(tmp_dir + "/sort_uniq_ESS." + std::to_string(::getpid()) + "." + std::to_string(runs.size()) + ".bin");
+    }
+    #pragma omp parallel for schedule(static, 1)
+    for (int i = 0; i < num_pieces; i++) {
+      Entry* first = buf.data() + buf.size() * i / num_pieces;
+      Entry* last = buf.data() + buf.size() * (i + 1) / num_pieces;
+      std::sort(first, last);
+      last = std::unique(first, last);
+      EntryFile::Write(runs[first_run + i].c_str(), first, last, true);
+    }
+  }
+  void RemoveRuns() {
+    for (const std::string& run: runs) { std::remove(run.c_str()); }
+    runs.clear();
+  }
+};
+
+#endif  // EXTERNAL_SORT_HPP
@@ -4,22 +4,99 @@
 #include <iostream>
 #include <sstream>
 #include <cmath>
-#include <functional>
 #include <iomanip>
+#include <algorithm>
+#include <array>
+#include <bitset>
 #include <icecream.hpp>
 #include <Eigen/Dense>
 #include "Strategy.hpp"
+#include "TransitionTensor.hpp"
 
 class Game {
   public:
   using v3d_t = std::array<double,3>;
-  Game(double mu_e, double mu_a, const ReputationDynamics& rd, const ActionRule& ar) : mu_e(mu_e), mu_a(mu_a), strategy(rd, ar) {
+  enum class Integrator {
+    RK4,    // classical Runge-Kutta with a fixed time step dt = 0.01
+    DOPRI5  // Dormand-Prince 5(4) with adaptive step size control
+  };
+  enum class MutantSolver {
+    Linear,           // solve the linear equation for the stationary distribution of the mutant directly
+    TimeIntegration,  // integrate MutantFlux in time
+    Verify            // solve by both methods and throw if they disagree
+  };
+  enum class MutantOrder {  // order of the mutants examined in FindNegativePayoffDiff and ESS_Benefit_Range
+    ID,         // in the order of the IDs
+    Neighbors,  // the mutants differing from the resident at a single slot first, then the others in the order of the IDs
+    Learned     // the single-slot neighbors first, then the others in the descending order of the number of invasions so far
+  };
+  struct SolverStats {  // accumulated over all the ODE solves of this game (resident and mutants)
+    size_t n_solves = 0;      // number of calls of the integrator
+    size_t n_steps = 0;       // number of accepted steps
+    size_t n_rejected = 0;    // number of rejected steps (always zero for RK4)
+    size_t n_flux_evals = 0;  // number of evaluations of the right hand side
+    size_t n_newton_iters = 0;  // number of Newton iterations (each needs a flux and a Jacobian evaluation)
+    size_t n_newton_fallbacks = 0;  // number of resident solves where Newton's method was not accepted
+    size_t n_linear_solves = 0;  // number of mutant equilibria found by the linear solver
+    size_t n_linear_fallbacks = 0;  // number of mutant equilibria left to the time integration since the linear system is singular or its solution is invalid
+    size_t n_mutant_evals = 0;   // number of mutants compared with the resident
+    size_t n_early_abandons = 0;  // number of resident solves abandoned since the cooperation probability cannot exceed the threshold
+  };
+  struct SolverOption {
+    Integrator integrator = Integrator::RK4;
+    bool newton_resident = false;  // find the resident h* by Newton's method seeded from the trajectory
+    MutantSolver mutant_solver = MutantSolver::Linear;
+    MutantOrder mutant_order = MutantOrder::ID;
+  };
+  // number of the games invaded by each mutant, counted separately by each thread. It is recorded and used only by MutantOrder::Learned.
+  class InvasionCounter {
+    public:
+    InvasionCounter() : n_recorded(0) {
+      counts.fill(0);
+      for (uint16_t i = 0; i < 512; i++) { order[i] = i; }
+    }
+    void Record(uint64_t mutant_id) {
+      counts[mutant_id]++;
+      n_recorded++;
+      // sort frequently at the beginning, and every 1024 invasions afterwards
+      if ((n_recorded & (n_recorded - 1)) == 0 || n_recorded % 1024 == 0) {
+        std::stable_sort(order.begin(), order.end(), [this](uint16_t a, uint16_t b) { return counts[a] > counts[b]; });
+      }
+    }
+    uint64_t Count(uint64_t mutant_id) const { return counts[mutant_id]; }
+    const std::array<uint16_t,512>& Order() const { return order; }  // mutant IDs in the descending order of the counts
+    private:
+    std::array<uint64_t,512> counts;
+    std::array<uint16_t,512> order;
+    uint64_t n_recorded;
+  };
+  static InvasionCounter& Invasions() { thread_local InvasionCounter c; return c; }
+  // solver options used by the games constructed afterwards
+  static SolverOption& DefaultSolverOption() { static SolverOption o; return o; }
+  static Integrator ParseIntegrator(const std::string& name) {
+    if (name == "RK4") { return Integrator::RK4; }
+    else if (name == "DOPRI5") { return Integrator::DOPRI5; }
+    else { throw std::runtime_error("unknown integrator: " + name); }
+  }
+  static MutantSolver ParseMutantSolver(const std::string& name) {
+    if (name == "linear") { return MutantSolver::Linear; }
+    else if (name == "time_integration") { return MutantSolver::TimeIntegration; }
+    else if (name == "verify") { return MutantSolver::Verify; }
+    else { throw std::runtime_error("unknown mutant solver: " + name); }
+  }
+  static MutantOrder ParseMutantOrder(const std::string& name) {
+    if (name == "id") { return MutantOrder::ID; }
+    else if (name == "neighbors") { return MutantOrder::Neighbors; }
+    else if (name == "learned") { return MutantOrder::Learned; }
+    else { throw std::runtime_error("unknown mutant order: " + name); }
+  }
+  Game(double mu_e, double mu_a, const ReputationDynamics& rd, const ActionRule& ar) : mu_e(mu_e), mu_a(mu_a), strategy(rd, ar), option(DefaultSolverOption()), transition(mu_e, mu_a, strategy.rd, strategy.ar) {
     resident_h_star_ready = false;
   }
-  Game(double mu_e, double mu_a, uint64_t id) : mu_e(mu_e), mu_a(mu_a), strategy(id) {
+  Game(double mu_e, double mu_a, uint64_t id) : mu_e(mu_e), mu_a(mu_a), strategy(id), option(DefaultSolverOption()), transition(mu_e, mu_a, strategy.rd, strategy.ar) {
     resident_h_star_ready = false;
   }
-  Game(double mu_e, double mu_a, uint64_t id, double coop_prob, const std::array<double,3>& h_star) : mu_e(mu_e), mu_a(mu_a), strategy(id) {
+  Game(double mu_e, double mu_a, uint64_t id, double coop_prob, const std::array<double,3>& h_star) : mu_e(mu_e), mu_a(mu_a), strategy(id), option(DefaultSolverOption()), transition(mu_e, mu_a, strategy.rd, strategy.ar) {
     resident_coop_prob = coop_prob;
     resident_h_star = h_star;
     resident_h_star_ready = true;
@@ -82,6 +159,8 @@ class Game {
   }
   const double mu_e, mu_a;
   const Strategy strategy;
+  SolverOption option;
+  const SolverStats& Stats() const { return solver_stats; }
   std::tuple<Action,Reputation,Reputation> At(Reputation donor, Reputation recipient) const {
     return strategy.At(donor, recipient);
   }
@@ -113,7 +192,9 @@ class Game {
 
     std::array<double,3> new_h = {h[Bi], h[Ni], h[Gi]};
 
-    return Game(mu_e, mu_a, new_g_id, ResidentCoopProb(), new_h);
+    Game new_g(mu_e, mu_a, new_g_id, ResidentCoopProb(), new_h);
+    new_g.option = option;
+    return new_g;
   }
   bool IsESS(double benefit, double cost) const {
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
@@ -121,17 +202,24 @@ class Game {
     // IC(p.first, p.second.ID());
     return p.first > 0.0;
   }
-  std::pair<double,ActionRule> FindNegativePayoffDiff(double benefit, double cost) const { // an index of evolutionary stability
+  // An index of evolutionary stability. The mutants are examined in the order of option.mutant_order.
+  // For an ESS, it returns the smallest payoff difference and the mutant giving it, irrespective of the order.
+  // Otherwise, the examination stops at the first mutant that invades, so the returned pair depends on the order.
+  std::pair<double,ActionRule> FindNegativePayoffDiff(double benefit, double cost) const {
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
-    double res_payoff = MutantPayoff(strategy.ar, benefit, cost);
+    MutantEqCache mut_eq(*this);
+    double res_payoff = MutantPayoff(strategy.ar, mut_eq.At(strategy.ar), benefit, cost);
     double min = std::numeric_limits<double>::max();
     ActionRule highest_mut = strategy.ar;
-    for (int i = 0; i < 512; i++) {
-      if (i == strategy.ar.ID()) continue;
+    for (uint16_t i: MutantOrderList()) {
       ActionRule mut_ar(i);
-      double d = res_payoff - MutantPayoff(mut_ar, benefit, cost);
+      solver_stats.n_mutant_evals++;
+      double d = res_payoff - MutantPayoff(mut_ar, mut_eq.At(mut_ar), benefit, cost);
       if (d < min) { min = d; highest_mut = mut_ar; }
-      if (min < 0.0) break;
+      if (min < 0.0) {
+        if (option.mutant_order == MutantOrder::Learned) { Invasions().Record(i); }
+        break;
+      }
     }
     return std::make_pair(min, highest_mut);
   }
@@ -139,28 +227,35 @@ class Game {
     // stop calculating b_range when lower_bound exceeds lower_bound_max
     // or upper_bound go below upper_bound_min
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
-    double res_res_coop = ResidentCoopProb();
-    // IC(res_res_coop, MutantCoopProbs(strategy.ar));
 
     double b_lower_bound = std::numeric_limits<double>::min();
     double b_upper_bound = std::numeric_limits<double>::max();
 
-    for (int i = 0; i < 512; i++) {
-      if (i == strategy.ar.ID()) continue;
+    MutantEqCache mut_eq(*this);
+    // As in FindNegativePayoffDiff, the payoff of the resident is calculated from the equilibrium of its own class of mutants
+    // so that IsESS(b) holds for b in the range. Using ResidentCoopProb() instead, the neutral mutants differing from the resident
+    // only at the free slots would make the range empty due to the convergence error of h*.
+    auto p_res = MutantCoopProbs(strategy.ar, mut_eq.At(strategy.ar));
+    double res_res_coop = p_res.first;   // cooperation prob of resident for resident (cost side)
+    double res_res_recv = p_res.second;  // cooperation prob of resident for resident (benefit side)
+    // IC(res_res_coop, MutantCoopProbs(strategy.ar));
+
+    for (uint16_t i: MutantOrderList()) {
       ActionRule mut_ar(i);
-      auto p = MutantCoopProbs(mut_ar);
+      solver_stats.n_mutant_evals++;
+      auto p = MutantCoopProbs(mut_ar, mut_eq.At(mut_ar));
       double mut_res_coop = p.first;
       double res_mut_coop = p.second;
 
-      if (res_res_coop > res_mut_coop) {
-        double b_lower = (res_res_coop - mut_res_coop) / (res_res_coop - res_mut_coop);
+      if (res_res_recv > res_mut_coop) {
+        double b_lower = (res_res_coop - mut_res_coop) / (res_res_recv - res_mut_coop);
         if (b_lower > b_lower_bound) { b_lower_bound = b_lower; }
       }
-      else if (res_res_coop < res_mut_coop) {
-        double b_upper = (res_res_coop - mut_res_coop) / (res_res_coop - res_mut_coop);
+      else if (res_res_recv < res_mut_coop) {
+        double b_upper = (res_res_coop - mut_res_coop) / (res_res_recv - res_mut_coop);
         if (b_upper < b_upper_bound) { b_upper_bound = b_upper; }  // update the upper bound of b
       }
-      else {  // res_coop_prob == mut_res_coop
+      else {  // res_res_recv == res_mut_coop
         if (mut_res_coop <= res_res_coop) {  // cannot be ESS
           b_lower_bound = std::numeric_limits<double>::max();
           b_upper_bound = std::numeric_limits<double>::min();
@@ -171,12 +266,79 @@ class Game {
         // no ESS range is found between [upper_bound_min, lower_bound_max]
         b_lower_bound = std::numeric_limits<double>::max();
         b_upper_bound = std::numeric_limits<double>::min();
+        if (option.mutant_order == MutantOrder::Learned) { Invasions().Record(i); }
         break;
       }
     }
 
     return std::array<double,2>({b_lower_bound, b_upper_bound});
   }
+  // Calculate the resident h* by Newton's method starting from init, e.g., h* of the same norm at slightly different error rates.
+  // It is not checked whether the trajectory from the uniform distribution reaches the same attractor.
+  // Returns false and leaves the cache not ready when it does not converge to a stable fixed point.
+  bool CalcHStarResidentByNewtonFrom(const v3d_t& init) {
+    if (resident_h_star_ready) return false;
+    v3d_t h = init;
+    if (!NewtonResident(transition.c, h)) return false;
+    resident_h_star = h;
+    resident_coop_prob = CooperationProb(strategy.ar, resident_h_star, resident_h_star);
+    resident_h_star_ready = true;
+    return true;
+  }
+  // Calculate the resident h* unless the cooperation probability at h* is estimated not to exceed coop_prob_th.
+  // The trajectory from the uniform distribution is integrated in segments, and the decay rate of |dh/dt| is measured in each segment.
+  // As the rate may keep decreasing, e.g., when the trajectory approaches h* along a slow manifold, its limit lambda is extrapolated
+  // from the last three rates assuming their differences decrease geometrically. The distance to h* is then estimated as |dh/dt|_1 / lambda.
+  // Since the cooperation probability changes at most by twice the change of h in L1 norm, C(h*) is estimated not to exceed
+  // C(h) + 2 * safety * |dh/dt|_1 / lambda. When this estimate does not exceed coop_prob_th, the integration is abandoned and the cache remains not ready.
+  // This is a heuristic, not a bound: the extrapolation of lambda may overshoot, e.g., when the decay slows down after the last three segments,
+  // and then a cooperative norm (and possibly an ESS) is discarded.
+  // With option.newton_resident, nothing is abandoned: h* is always solved to the end by CalcHStarResident.
+  // As the other solves, it throws "does not converge" when the segments take MaxIntegrationSteps steps in total.
+  // Returns ResidentCoopProb() > coop_prob_th, or false when abandoned.
+  bool CalcHStarResidentAbove(double coop_prob_th) {
+    if (resident_h_star_ready) return resident_coop_prob > coop_prob_th;
+    if (option.newton_resident) {
+      CalcHStarResident();
+      return resident_coop_prob > coop_prob_th;
+    }
+    const ResidentFlux func(transition);
+    const double t_segment = 2.0, safety = 2.0;
+    v3d_t ht = {1.0/3.0, 1.0/3.0, 1.0/3.0};
+    double prev_norm = -1.0, dt = 0.01;  // the step size of DOPRI5 is carried over to the next segment
+    std::array<double,3> rates = {-1.0, -1.0, -1.0};  // decay rates of the last three segments
+    const size_t steps_begin = solver_stats.n_steps + solver_stats.n_rejected;
+    while (true) {
+      auto p = Integrate(func, ht, t_segment, &dt);
+      ht = p.first;
+      if (p.second) break;
+      if (solver_stats.n_steps + solver_stats.n_rejected - steps_begin >= MaxIntegrationSteps) {
+        IC(Inspect(), ht);
+        throw std::runtime_error("does not converge");
+      }
+      v3d_t f = func(ht);
+      solver_stats.n_flux_evals++;
+      double norm = std::abs(f[0]) + std::abs(f[1]) + std::abs(f[2]);
+      rates = {rates[1], rates[2], (prev_norm > 0.0 && norm < prev_norm) ? std::log(prev_norm / norm) / t_segment : -1.0};
+      prev_norm = norm;
+      if (rates[0] <= 0.0 || rates[1] <= 0.0 || rates[2] <= 0.0) continue;
+      double d1 = rates[0] - rates[1], d2 = rates[1] - rates[2];
+      double lambda;
+      if (d2 <= 0.0) { lambda = std::min(rates[1], rates[2]); }
+      else if (d1 > d2) { lambda = rates[2] - d2 * d2 / (d1 - d2); }
+      else { continue; }  // the decay keeps slowing down
+      if (lambda <= 0.0) continue;
+      double estimate = CooperationProb(strategy.ar, ht, ht) + 2.0 * safety * norm / lambda;
+      if (estimate <= coop_prob_th) {
+        solver_stats.n_early_abandons++;
+        return false;
+      }
+    }
+    resident_h_star = ht;
+    resident_coop_prob = CooperationProb(strategy.ar, resident_h_star, resident_h_star);
+    resident_h_star_ready = true;
+    return resident_coop_prob > coop_prob_th;
+  }
   v3d_t ResidentEqReputation() { CalcHStarResident(); return resident_h_star; } // equilibrium reputation of resident species
   v3d_t ResidentEqReputation() const {
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
@@ -189,21 +351,71 @@ class Game {
   }
   v3d_t HStarMutant(const ActionRule& mutant_action_rule) const {
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
-    std::function<std::array<double,3>(std::array<double,3>)> func = [this,&mutant_action_rule](std::array<double,3> x) {
-      return HdotMutant(x, mutant_action_rule);
-    };
-    return SolveByRungeKutta(func);
+    const TransitionTensor mutant_transition(mu_e, mu_a, strategy.rd, mutant_action_rule);
+    const MutantFlux func(mutant_transition, resident_h_star);
+    if (option.mutant_solver == MutantSolver::TimeIntegration) { return SolveODE(func); }
+    v3d_t h_lin;
+    if (!SolveMutantLinear(mutant_transition, h_lin)) { return SolveODE(func); }
+    if (option.mutant_solver == MutantSolver::Verify) {
+      v3d_t h_rk = SolveODE(func);
+      const double tolerance = 1.0e-3;
+      for (int i = 0; i < 3; i++) {
+        if (std::abs(h_rk[i] - h_lin[i]) > tolerance) {
+          IC(Inspect(), mutant_action_rule.ID(), h_lin, h_rk);
+          throw std::runtime_error("linear solver and time integration disagree");
+        }
+      }
+    }
+    return h_lin;
+  }
+  // Mutants whose action rules differ only at the slots where the action does not change the donor's reputation
+  // follow the identical dynamics. The representative of such a class defects at all those slots, i.e., it is the cheapest one.
+  uint64_t FreeSlotMask() const {  // bit i is set when the action at (i/3, i%3) does not matter
+    uint64_t mask = 0;
+    for (int i = 0; i < 9; i++) {
+      Reputation X = static_cast<Reputation>(i/3);
+      Reputation Y = static_cast<Reputation>(i%3);
+      if (strategy.rd.RepAt(X, Y, Action::C) == strategy.rd.RepAt(X, Y, Action::D)) { mask |= (1ull << i); }
+    }
+    return mask;
+  }
+  // IDs of the mutants except for the resident in the order specified by option.mutant_order
+  std::vector<uint16_t> MutantOrderList() const {
+    const uint16_t res = static_cast<uint16_t>(strategy.ar.ID());
+    auto is_neighbor = [res](uint16_t i) { uint16_t d = i ^ res; return d != 0 && (d & (d - 1)) == 0; };
+    std::vector<uint16_t> ans;
+    ans.reserve(511);
+    if (option.mutant_order == MutantOrder::ID) {
+      for (uint16_t i = 0; i < 512; i++) { if (i != res) ans.push_back(i); }
+      return ans;
+    }
+    for (int n = 0; n < 9; n++) { ans.push_back(res ^ (1u << n)); }
+    if (option.mutant_order == MutantOrder::Neighbors) {
+      for (uint16_t i = 0; i < 512; i++) { if (i != res && !is_neighbor(i)) ans.push_back(i); }
+    }
+    else {
+      for (uint16_t i: Invasions().Order()) { if (i != res && !is_neighbor(i)) ans.push_back(i); }
+    }
+    return ans;
+  }
+  ActionRule MutantClassRepresentative(const ActionRule& mutant) const {
+    return ActionRule(mutant.ID() & ~FreeSlotMask());
   }
   std::pair<double,double> MutantCoopProbs(const ActionRule& mutant) const {
     if (!resident_h_star_ready) throw std::runtime_error("cache is not ready");
-    v3d_t mut_rep = HStarMutant(mutant);
+    return MutantCoopProbs(mutant, HStarMutant(mutant));
+  }
+  std::pair<double,double> MutantCoopProbs(const ActionRule& mutant, const v3d_t& mut_rep) const {
     // cooperation probability of mutant against resident
     double mut_res_coop = CooperationProb(mutant, mut_rep, resident_h_star); // cooperation prob of mutant for resident
     double res_mut_coop = CooperationProb(strategy.ar, resident_h_star, mut_rep); // cooperation prob of resident for mutant
     return std::make_pair(mut_res_coop, res_mut_coop);
   }
   double MutantPayoff(const ActionRule& mutant, double benefit, double cost) const {
-    auto p = MutantCoopProbs(mutant);
+    return MutantPayoff(mutant, HStarMutant(mutant), benefit, cost);
+  }
+  double MutantPayoff(const ActionRule& mutant, const v3d_t& mut_rep, double benefit, double cost) const {
+    auto p = MutantCoopProbs(mutant, mut_rep);
     double mut_res_coop = p.first;
     double res_mut_coop = p.second;
     return benefit * res_mut_coop - cost * mut_res_coop;
@@ -254,10 +466,8 @@ class Game {
     return {ans_e(0), ans_e(1), ans_e(2)};
   }
   v3d_t CalcHStarFromInitialPoint(const v3d_t & init) {
-    std::function<std::array<double,3>(std::array<double,3>)> func = [this](std::array<double,3> x) {
-      return HdotResident(x);
-    };
-    auto ans = SolveByRungeKutta(func, init);
+    const ResidentFlux func(transition);
+    auto ans = SolveODE(func, init);
     return ans;
   }
 
@@ -265,50 +475,157 @@ class Game {
   v3d_t resident_h_star; // equilibrium reputation of resident species
   double resident_coop_prob;  // cooperation probability of resident species
   bool resident_h_star_ready; // if true, resident_h_star and resident_coop_prob are ready
+  mutable SolverStats solver_stats;
+  const TransitionTensor transition;  // compiled coefficients of the resident dynamics
+  // equilibrium reputations of mutants, which are calculated only once for each class of mutants having the identical dynamics
+  // The entries for all the 512 IDs are kept on the stack so that a sweep over the mutants does not allocate.
+  class MutantEqCache {
+    public:
+    explicit MutantEqCache(const Game& _g) : g(_g), free_mask(_g.FreeSlotMask()) {};
+    const v3d_t& At(const ActionRule& mutant) {
+      uint64_t rep = mutant.ID() & ~free_mask;
+      if (!ready[rep]) {
+        h[rep] = g.HStarMutant(ActionRule(rep));
+        ready[rep] = true;
+      }
+      return h[rep];
+    }
+    private:
+    const Game& g;
+    const uint64_t free_mask;
+    std::bitset<512> ready;
+    std::array<v3d_t,512> h;  // not initialized. Only the entries marked in ready are read.
+  };
   void CalcHStarResident() {
     if (resident_h_star_ready) return;
-    std::function<std::array<double,3>(std::array<double,3>)> func = [this](std::array<double,3> x) {
-      return HdotResident(x);
-    };
-    resident_h_star = SolveByRungeKutta(func);
+    const ResidentFlux func(transition);
+    if (option.newton_resident) {
+      resident_h_star = SolveResidentByNewton(func);
+    }
+    else {
+      resident_h_star = SolveODE(func);
+    }
     resident_coop_prob = CooperationProb(strategy.ar, resident_h_star, resident_h_star);
     resident_h_star_ready = true;
   }
-  v3d_t HdotResident(const std::array<double,3>& ht) const {
-    v3d_t ht_dot = {-ht[0], -ht[1], -ht[2]};
-    for (int i = 0; i < 3; i++) {
-      Reputation X = static_cast<Reputation>(i);
-      for (int j = 0; j < 3; j++) {
-        Reputation Y = static_cast<Reputation>(j);
-        for (int k = 0; k < 3; k++) {
-          Reputation Z = static_cast<Reputation>(k);
-          int b1 = (strategy.rd.RepAt(X, Y, strategy.ar.ActAt(X, Y)) == Z) ? 1 : 0;
-          int b2 = (strategy.rd.RepAt(X, Y, Action::D) == Z) ? 1 : 0;
-          ht_dot[k] += ht[i] * ht[j] * ( (1.0-1.5*mu_a)*((1.0-mu_e)*b1+ mu_e*b2) + 0.5*mu_a);
+  // Newton's method for ResidentFlux(h) = 0 on the 2-simplex, where h_2 = 1 - h_0 - h_1 is eliminated.
+  // Returns true if it converges to a fixed point inside the simplex which is stable along the simplex.
+  bool NewtonResident(const std::array<double,27>& c, v3d_t& h) const {
+    const size_t N_ITER = 50;
+    const double tolerance = 1.0e-14;
+    for (size_t n = 0; n < N_ITER; n++) {
+      // flux f and its Jacobian df_k/dh_m
+      v3d_t f = {-h[0], -h[1], -h[2]};
+      double jac[3][3] = {{-1.0, 0.0, 0.0}, {0.0, -1.0, 0.0}, {0.0, 0.0, -1.0}};
+      for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 3; j++) {
+          for (int k = 0; k < 3; k++) {
+            double cijk = c[9*i+3*j+k];
+            f[k] += h[i] * h[j] * cijk;
+            jac[k][i] += h[j] * cijk;
+            jac[k][j] += h[i] * cijk;
+          }
         }
       }
+      // Jacobian along the simplex
+      double a = jac[0][0] - jac[0][2], b = jac[0][1] - jac[0][2];
+      double d = jac[1][0] - jac[1][2], e = jac[1][1] - jac[1][2];
+      double det = a * e - b * d;
+      solver_stats.n_newton_iters++;
+      solver_stats.n_flux_evals++;
+      if (std::abs(f[0]) < tolerance && std::abs(f[1]) < tolerance && std::abs(f[2]) < tolerance) {
+        bool inside = (h[0] >= 0.0 && h[1] >= 0.0 && h[2] >= 0.0);
+        bool stable = (a + e < 0.0 && det > 0.0);
+        return inside && stable;
+      }
+      if (det == 0.0 || !std::isfinite(det)) { return false; }
+      double dx0 = -( e * f[0] - b * f[1]) / det;
+      double dx1 = -(-d * f[0] + a * f[1]) / det;
+      h[0] += dx0;
+      h[1] += dx1;
+      h[2] = 1.0 - h[0] - h[1];
     }
-    return ht_dot;
+    return false;
   }
-  v3d_t HdotMutant(const std::array<double,3>& ht, const ActionRule& mutant_action_rule) const {
-    v3d_t ht_dot = {-ht[0], -ht[1], -ht[2]};
+  // Find the resident h* by Newton's method seeded from the points on the trajectory starting from the uniform distribution.
+  // A root is accepted when it is a stable fixed point, the trajectory is heading to it, and either it is close to the seed
+  // or the previous seed has converged to the same root. Thus, it is the attractor the time integration would reach.
+  // When no root is accepted, it falls back to the time integration continued from the last seed.
+  v3d_t SolveResidentByNewton(const ResidentFlux& func) const {
+    const std::array<double,27>& c = transition.c;
+    const size_t N_SEEDS = 8;
+    const double max_distance = 0.01, same_root_tolerance = 1.0e-10;
+    v3d_t ht = {1.0/3.0, 1.0/3.0, 1.0/3.0};
+    v3d_t prev_root = {-1.0, -1.0, -1.0};
+    double t_segment = 1.0;
+    for (size_t s = 0; s < N_SEEDS; s++, t_segment *= 2.0) {
+      auto p = Integrate(func, ht, t_segment);
+      ht = p.first;
+      if (p.second) { return ht; }  // the time integration has already converged
+      v3d_t root = ht;
+      if (!NewtonResident(c, root)) { prev_root = {-1.0, -1.0, -1.0}; continue; }
+      v3d_t f = func(ht);
+      solver_stats.n_flux_evals++;
+      double dist = 0.0, heading = 0.0, diff_prev = 0.0;
+      for (int i = 0; i < 3; i++) {
+        dist += std::abs(root[i] - ht[i]);
+        heading += f[i] * (root[i] - ht[i]);
+        diff_prev += std::abs(root[i] - prev_root[i]);
+      }
+      if (heading > 0.0 && (dist < max_distance || diff_prev < same_root_tolerance)) { return root; }
+      prev_root = root;
+    }
+    solver_stats.n_newton_fallbacks++;
+    return SolveODE(func, ht);
+  }
+  // Since the recipients are residents, MutantFlux is linear in the mutant's reputation:
+  //   dh_k/dt = -h_k + sum_i h_i M_ik, where M_ik = sum_j h*_j c_ijk is a stochastic matrix.
+  // Its equilibrium is the stationary distribution of M, i.e., (M^T - I) h = 0 with sum_k h_k = 1.
+  // Returns false when the system is singular, i.e., M has several stationary distributions (e.g., when mu_a = 0), or when the
+  // solution is not a valid distribution. The time integration is used instead, as the distribution it reaches depends on the initial state.
+  // Since the columns of M^T - I sum to zero, replacing one of its rows keeps the rank, and the system is singular iff M^T - I has rank < 2.
+  bool SolveMutantLinear(const TransitionTensor& mutant_transition, v3d_t& h) const {
+    Eigen::Matrix3d A;
+    A << -1,0,0, 0,-1,0, 0,0,-1;
     for (int i = 0; i < 3; i++) {
-      Reputation X = static_cast<Reputation>(i);
       for (int j = 0; j < 3; j++) {
-        Reputation Y = static_cast<Reputation>(j);
         for (int k = 0; k < 3; k++) {
-          Reputation Z = static_cast<Reputation>(k);
-          int b1 = (strategy.rd.RepAt(X, Y, mutant_action_rule.ActAt(X, Y)) == Z) ? 1 : 0;
-          int b2 = (strategy.rd.RepAt(X, Y, Action::D) == Z) ? 1 : 0;
-          ht_dot[k] += ht[i] * resident_h_star[j] * ((1.0 - 1.5 * mu_a) * ((1.0 - mu_e) * b1 + mu_e * b2) + 0.5 * mu_a);
+          A(k, i) += resident_h_star[j] * mutant_transition.At(i, j, k);
         }
       }
     }
-    return ht_dot;
+    A.row(2) << 1, 1, 1;  // one of the equations is redundant. Replace it with the normalization
+    Eigen::Vector3d b(0, 0, 1);
+    const Eigen::FullPivLU<Eigen::Matrix3d> lu(A);
+    if (lu.rank() < 3) { solver_stats.n_linear_fallbacks++; return false; }
+    Eigen::Vector3d x = lu.solve(b);
+    for (int k = 0; k < 3; k++) {
+      if (!std::isfinite(x(k)) || x(k) < -1.0e-12) { solver_stats.n_linear_fallbacks++; return false; }
+      h[k] = std::max(x(k), 0.0);
+    }
+    solver_stats.n_linear_solves++;
+    return true;
+  }
+  // The integrators are templates on the flux functor (ResidentFlux or MutantFlux) so that the flux is inlined in the loop.
+  template <typename F>
+  v3d_t SolveODE(const F& func, const v3d_t& init = {1.0/3.0,1.0/3.0,1.0/3.0}) const {
+    return Integrate(func, init, std::numeric_limits<double>::infinity()).first;
   }
-  v3d_t SolveByRungeKutta(std::function<v3d_t (v3d_t)>& func, const v3d_t& init = {1.0/3.0,1.0/3.0,1.0/3.0}) const {
+  // maximum number of the steps of a solve, after which it throws "does not converge"
+  static constexpr size_t MaxIntegrationSteps = 10'000'000;
+  // integrate dh/dt = func(h) until it converges or the time reaches t_max
+  // returns the final state and whether it has converged
+  // When dt is given, the adaptive integrator starts from the step size *dt and stores the step size to continue with.
+  template <typename F>
+  std::pair<v3d_t,bool> Integrate(const F& func, const v3d_t& init, double t_max, double* dt = nullptr) const {
+    solver_stats.n_solves++;
+    if (option.integrator == Integrator::DOPRI5) { return IntegrateByDormandPrince(func, init, t_max, dt); }
+    else { return IntegrateByRungeKutta(func, init, t_max); }
+  }
+  template <typename F>
+  std::pair<v3d_t,bool> IntegrateByRungeKutta(const F& func, const v3d_t& init, double t_max) const {
     v3d_t ht = init;
-    const size_t N_ITER = 10'000'000;
+    const size_t N_ITER = MaxIntegrationSteps;
     double dt = 0.01;
     const double conv_tolerance = 1.0e-6 * dt;
     for (size_t t = 0; t < N_ITER; t++) {
@@ -339,6 +656,8 @@ class Game {
       for(int i = 0; i < 3; i++) {
         k4[i] *= dt;
       }
+      solver_stats.n_steps++;
+      solver_stats.n_flux_evals += 4;
       v3d_t delta;
       double sum = 0.0;
       for (int i = 0; i < 3; i++) {
@@ -355,12 +674,92 @@ class Game {
           std::abs(delta[2]) < conv_tolerance) {
         break;
       }
+      if ((t+1) * dt >= t_max) {
+        return std::make_pair(ht, false);
+      }
       if (t == N_ITER-1) {
         IC(Inspect(), delta, ht);
         throw std::runtime_error("does not converge");
       }
     }
-    return ht;
+    return std::make_pair(ht, true);
+  }
+  // Dormand-Prince 5(4) pair with the first-same-as-last property.
+  // The step size is controlled by the embedded 4th order estimate and the convergence criterion is the same as RK4's, i.e., |dh/dt| < 1e-6.
+  // Thus, h* agrees with the one of IntegrateByRungeKutta within about 1e-6/lambda, where lambda is the slowest relaxation rate.
+  // (within 1e-5 for the games with mu = 1e-3 in test_Game.)
+  template <typename F>
+  std::pair<v3d_t,bool> IntegrateByDormandPrince(const F& func, const v3d_t& init, double t_max, double* dt_io) const {
+    const size_t N_ITER = MaxIntegrationSteps;
+    const double conv_tolerance = 1.0e-6;
+    const double atol = 1.0e-12, rtol = 1.0e-9;
+    const double a21 = 1.0/5.0;
+    const double a31 = 3.0/40.0, a32 = 9.0/40.0;
+    const double a41 = 44.0/45.0, a42 = -56.0/15.0, a43 = 32.0/9.0;
+    const double a51 = 19372.0/6561.0, a52 = -25360.0/2187.0, a53 = 64448.0/6561.0, a54 = -212.0/729.0;
+    const double a61 = 9017.0/3168.0, a62 = -355.0/33.0, a63 = 46732.0/5247.0, a64 = 49.0/176.0, a65 = -5103.0/18656.0;
+    const double b1 = 35.0/384.0, b3 = 500.0/1113.0, b4 = 125.0/192.0, b5 = -2187.0/6784.0, b6 = 11.0/84.0;
+    // difference between the 5th and the 4th order weights
+    const double e1 = 71.0/57600.0, e3 = -71.0/16695.0, e4 = 71.0/1920.0, e5 = -17253.0/339200.0, e6 = 22.0/525.0, e7 = -1.0/40.0;
+
+    v3d_t ht = init;
+    double dt = dt_io ? *dt_io : 0.01, time = 0.0;
+    double dt_free = dt;  // the step size proposed by the controller before it is cut at t_max
+    v3d_t k1 = func(ht);
+    solver_stats.n_flux_evals++;
+    for (size_t t = 0; t < N_ITER; t++) {
+      dt_free = dt;
+      if (time + dt > t_max) { dt = t_max - time; }
+      v3d_t arg;
+      for (int i = 0; i < 3; i++) { arg[i] = ht[i] + dt * a21 * k1[i]; }
+      v3d_t k2 = func(arg);
+      for (int i = 0; i < 3; i++) { arg[i] = ht[i] + dt * (a31 * k1[i] + a32 * k2[i]); }
+      v3d_t k3 = func(arg);
+      for (int i = 0; i < 3; i++) { arg[i] = ht[i] + dt * (a41 * k1[i] + a42 * k2[i] + a43 * k3[i]); }
+      v3d_t k4 = func(arg);
+      for (int i = 0; i < 3; i++) { arg[i] = ht[i] + dt * (a51 * k1[i] + a52 * k2[i] + a53 * k3[i] + a54 * k4[i]); }
+      v3d_t k5 = func(arg);
+      for (int i = 0; i < 3; i++) { arg[i] = ht[i] + dt * (a61 * k1[i] + a62 * k2[i] + a63 * k3[i] + a64 * k4[i] + a65 * k5[i]); }
+      v3d_t k6 = func(arg);
+      v3d_t h_new;
+      for (int i = 0; i < 3; i++) { h_new[i] = ht[i] + dt * (b1 * k1[i] + b3 * k3[i] + b4 * k4[i] + b5 * k5[i] + b6 * k6[i]); }
+      v3d_t k7 = func(h_new);
+      solver_stats.n_flux_evals += 6;
+
+      double err = 0.0;
+      for (int i = 0; i < 3; i++) {
+        double e = dt * (e1 * k1[i] + e3 * k3[i] + e4 * k4[i] + e5 * k5[i] + e6 * k6[i] + e7 * k7[i]);
+        double sc = atol + rtol * std::max(std::abs(ht[i]), std::abs(h_new[i]));
+        err += (e / sc) * (e / sc);
+      }
+      err = std::sqrt(err / 3.0);
+
+      if (err <= 1.0) {
+        solver_stats.n_steps++;
+        double sum = h_new[0] + h_new[1] + h_new[2];
+        double sum_inv = 1.0 / sum;
+        for (int i = 0; i < 3; i++) { ht[i] = h_new[i] * sum_inv; }
+        k1 = k7;
+        time += dt;
+        if (std::abs(k1[0]) < conv_tolerance &&
+            std::abs(k1[1]) < conv_tolerance &&
+            std::abs(k1[2]) < conv_tolerance) {
+          return std::make_pair(ht, true);
+        }
+        if (time >= t_max) {
+          if (dt_io) { *dt_io = dt_free; }
+          return std::make_pair(ht, false);
+        }
+      }
+      else {
+        solver_stats.n_rejected++;
+      }
+      // standard step size controller with the safety factor 0.9
+      double factor = (err == 0.0) ? 5.0 : 0.9 * std::pow(err, -0.2);
+      dt *= std::min(5.0, std::max(0.2, factor));
+    }
+    IC(Inspect(), k1, ht);
+    throw std::runtime_error("does not converge");
   }
   double CooperationProb(const ActionRule& donor_action, const std::array<double,3>& donor_reputation, const std::array<double,3>& recip_reputation) const {
     double sum = 0.0;
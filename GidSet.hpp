@@ -0,0 +1,217 @@
+#ifndef GID_SET_HPP
+#define GID_SET_HPP
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <memory>
+#include <algorithm>
+#include <stdexcept>
+#include "MappedFile.hpp"
+
+
+// Compressed set of GameIDs. The sorted GameIDs are divided into blocks of 128, and the differences between consecutive ones are stored as varints.
+// The first GameID and the position of each block are tabulated so that Contains and Rank take a binary search and a decoding of a single block.
+// An ESS set is sparse in the space of 2^38 GameIDs, and a GameID costs about 3 bytes, while a dense set costs about 1 byte per GameID.
+// A set loaded from a file is memory-mapped, so a query reads only the table and the block it needs. Such a set is read-only.
+class GidSet {
+  public:
+  static constexpr size_t BlockSize = 128;
+  GidSet() : num(0), last(0) {};
+  // GameIDs must be added in the ascending order. Duplicates are ignored.
+  void Add(uint64_t gid) {
+    if (file) { throw std::runtime_error("GidSet loaded from a file is read-only"); }
+    if (num > 0 && gid <= last) {
+      if (gid == last) { return; }
+      throw std::runtime_error("GameIDs must be added in the ascending order");
+    }
+    if (num % BlockSize == 0) {
+      block_first.push_back(gid);
+      block_pos.push_back(bytes.size());
+    }
+    else {
+      uint64_t d = gid - last;
+      while (d >= 128) {
+        bytes.push_back(static_cast<uint8_t>(d | 128));
+        d >>= 7;
+      }
+      bytes.push_back(static_cast<uint8_t>(d));
+    }
+    last = gid;
+    num++;
+  }
+  template <class Iterator>
+  static GidSet FromSorted(Iterator first, Iterator last) {
+    GidSet s;
+    for (; first != last; ++first) { s.Add(*first); }
+    return s;
+  }
+
+  uint64_t Size() const { return num; }
+  size_t NumBytes() const { return Bytes().size() + BlockFirst().size() * (sizeof(uint64_t) * 2); }
+  bool Contains(uint64_t gid) const {
+    const ConstSpan<uint64_t> block_first = BlockFirst();
+    const size_t b = std::upper_bound(block_first.begin(), block_first.end(), gid) - block_first.begin();
+    if (b == 0) { return false; }
+    for (Iterator it(*this, b - 1); !it.AtEnd() && it.BlockIndex() == b - 1; it.Next()) {
+      if (*it >= gid) { return *it == gid; }
+    }
+    return false;
+  }
+  // number of GameIDs smaller than gid. It is the index of gid when gid is in the set.
+  uint64_t Rank(uint64_t gid) const {
+    const ConstSpan<uint64_t> block_first = BlockFirst();
+    const size_t b = std::lower_bound(block_first.begin(), block_first.end(), gid) - block_first.begin();
+    if (b == 0) { return 0; }
+    uint64_t n = (b - 1) * BlockSize;
+    for (Iterator it(*this, b - 1); !it.AtEnd() && it.BlockIndex() == b - 1 && *it < gid; it.Next()) { n++; }
+    return n;
+  }
+  // call f for each GameID in the ascending order
+  template <class F>
+  void ForEach(F f) const {
+    for (Iterator it(*this); !it.AtEnd(); it.Next()) { f(*it); }
+  }
+  std::vector<uint64_t> ToVector() const {
+    std::vector<uint64_t> v;
+    v.reserve(Size());
+    ForEach([&v](uint64_t gid) { v.push_back(gid); });
+    return v;
+  }
+
+  // sequential decoder of the GameIDs
+  class Iterator {
+    public:
+    explicit Iterator(const GidSet& _s, size_t block = 0) : s(_s), bytes(_s.Bytes().data()), idx(block * BlockSize), pos(0), end(0), gid(0) { Load(); }
+    bool AtEnd() const { return idx >= s.num; }
+    uint64_t operator*() const { return gid; }
+    size_t BlockIndex() const { return idx / BlockSize; }
+    void Next() {
+      idx++;
+      if (idx % BlockSize == 0) { Load(); return; }
+      if (AtEnd()) { return; }
+      uint64_t d = 0;
+      int shift = 0;
+      uint8_t c;
+      do {
+        if (pos >= end || shift >= 64) { throw std::runtime_error("GidSet is corrupt: a varint runs over its block"); }
+        c = bytes[pos++];
+        d |= static_cast<uint64_t>(c & 127) << shift;
+        shift += 7;
+      } while (c & 128);
+      gid += d;
+    }
+    private:
+    const GidSet& s;
+    const uint8_t* bytes;
+    uint64_t idx;  // index of the current GameID
+    size_t pos;    // position of the next varint
+    size_t end;    // end of the varints of the current block
+    uint64_t gid;
+    void Load() {
+      if (AtEnd()) { return; }
+      const size_t b = BlockIndex();
+      gid = s.BlockFirst()[b];
+      pos = s.BlockPos()[b];
+      end = (b + 1 < s.NumBlocks()) ? s.BlockPos()[b + 1] : s.Bytes().size();
+    }
+  };
+
+  static GidSet Union(const GidSet& a, const GidSet& b) { return Combine(a, b, true, true, true); }
+  static GidSet Intersection(const GidSet& a, const GidSet& b) { return Combine(a, b, false, true, false); }
+  // the GameIDs in a but not in b
+  static GidSet Difference(const GidSet& a, const GidSet& b) { return Combine(a, b, true, false, false); }
+
+  // The file consists of the magic "GIDSET01", the numbers of the GameIDs and the bytes, followed by the arrays.
+  // The header is 24 bytes, so the arrays are aligned when the file is mapped.
+  void Save(const std::string& path) const {
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout) { throw std::runtime_error("failed to open file: " + path); }
+    const uint64_t n_bytes = Bytes().size();
+    fout.write(Magic(), 8);
+    fout.write(reinterpret_cast<const char*>(&num), sizeof(num));
+    fout.write(reinterpret_cast<const char*>(&n_bytes), sizeof(n_bytes));
+    fout.write(reinterpret_cast<const char*>(BlockFirst().data()), BlockFirst().size() * sizeof(uint64_t));
+    fout.write(reinterpret_cast<const char*>(BlockPos().data()), BlockPos().size() * sizeof(uint64_t));
+    fout.write(reinterpret_cast<const char*>(Bytes().data()), n_bytes);
+    if (!fout) { throw std::runtime_error("failed to write file: " + path); }
+  }
+  static GidSet Load(const std::string& path) {
+    GidSet s;
+    s.file = std::make_shared<const MappedFile>(path);
+    const char* p = s.file->Data();
+    if (s.file->Size() < HeaderSize || std::memcmp(p, Magic(), 8) != 0) { throw std::runtime_error("not a GidSet file: " + path); }
+    uint64_t n_bytes = 0;
+    std::memcpy(&s.num, p + 8, sizeof(s.num));
+    std::memcpy(&n_bytes, p + 16, sizeof(n_bytes));
+    const size_t n_blocks = (s.num + BlockSize - 1) / BlockSize;
+    if (n_blocks > s.file->Size() / (2 * sizeof(uint64_t)) || n_bytes > s.file->Size()
+        || s.file->Size() != HeaderSize + n_blocks * 2 * sizeof(uint64_t) + n_bytes) { throw std::runtime_error("GidSet file is truncated: " + path); }
+    s.mapped_n_bytes = n_bytes;
+    // the tables must be monotone and point into the varints, so that a corrupt file is not read beyond the mapping
+    const ConstSpan<uint64_t> first = s.BlockFirst(), pos = s.BlockPos();
+    for (size_t b = 0; b < n_blocks; b++) {
+      if (pos[b] > n_bytes || (b == 0 && pos[b] != 0) || (b > 0 && (pos[b] < pos[b-1] || first[b] <= first[b-1]))) {
+        throw std::runtime_error("GidSet file is corrupt: " + path);
+      }
+    }
+    for (Iterator it(s, (n_blocks > 0) ? n_blocks - 1 : 0); !it.AtEnd(); it.Next()) { s.last = *it; }
+    return s;
+  }
+  static bool IsGidSetFile(const char* path) {
+    std::ifstream fin(path, std::ios::binary);
+    char magic[8];
+    return fin.read(magic, 8) && std::memcmp(magic, Magic(), 8) == 0;
+  }
+
+  private:
+  uint64_t num;
+  uint64_t last;  // the largest GameID
+  std::vector<uint64_t> block_first;  // the first GameID of each block
+  std::vector<uint64_t> block_pos;    // position of the varints of each block in bytes
+  std::vector<uint8_t> bytes;
+  std::shared_ptr<const MappedFile> file;  // the arrays are read from the mapped file instead of the vectors when it is set
+  uint64_t mapped_n_bytes = 0;
+  static constexpr size_t HeaderSize = 24;
+  static const char* Magic() { return "GIDSET01"; }
+  size_t NumBlocks() const { return (num + BlockSize - 1) / BlockSize; }
+  ConstSpan<uint64_t> BlockFirst() const {
+    if (!file) { return ConstSpan<uint64_t>(block_first.data(), block_first.size()); }
+    return ConstSpan<uint64_t>(reinterpret_cast<const uint64_t*>(file->Data() + HeaderSize), NumBlocks());
+  }
+  ConstSpan<uint64_t> BlockPos() const {
+    if (!file) { return ConstSpan<uint64_t>(block_pos.data(), block_pos.size()); }
+    return ConstSpan<uint64_t>(reinterpret_cast<const uint64_t*>(file->Data() + HeaderSize) + NumBlocks(), NumBlocks());
+  }
+  ConstSpan<uint8_t> Bytes() const {
+    if (!file) { return ConstSpan<uint8_t>(bytes.data(), bytes.size()); }
+    return ConstSpan<uint8_t>(reinterpret_cast<const uint8_t*>(file->Data() + HeaderSize + NumBlocks() * 2 * sizeof(uint64_t)), mapped_n_bytes);
+  }
+
+  // merge a and b, keeping the GameIDs only in a, in both, and only in b according to the flags
+  static GidSet Combine(const GidSet& a, const GidSet& b, bool only_a, bool both, bool only_b) {
+    GidSet s;
+    Iterator i(a), j(b);
+    while (!i.AtEnd() || !j.AtEnd()) {
+      if (j.AtEnd() || (!i.AtEnd() && *i < *j)) {
+        if (only_a) { s.Add(*i); }
+        i.Next();
+      }
+      else if (i.AtEnd() || *j < *i) {
+        if (only_b) { s.Add(*j); }
+        j.Next();
+      }
+      else {
+        if (both) { s.Add(*i); }
+        i.Next();
+        j.Next();
+      }
+    }
+    return s;
+  }
+};
+
+#endif  // GID_SET_HPP
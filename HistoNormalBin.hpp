@@ -3,52 +3,151 @@
 
 #include <iostream>
 #include <map>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <stdexcept>
 
 
-class HistoNormalBin {
+// Histogram whose counts are stored in a contiguous array from the first to the last bin touched so far.
+// The bins are either linear, [i * width, (i+1) * width), or logarithmic, [10^(i/bins_per_decade), 10^((i+1)/bins_per_decade)).
+// The latter is for h_B and h_N, which span decades as they scale with a power of mu. Non-positive values are counted separately on the log scale.
+// The array grows when a value falls outside of it, so Add is an index calculation and an increment for the values within the range seen so far.
+// The array is limited to MaxDenseBins bins, and the bins beyond it, e.g., of a far outlier, are counted in a sparse map instead.
+// NaN, infinity, and the values beyond 2^61 bins cannot be binned, and they are only counted.
+class HistoFlatBin {
   public:
-  HistoNormalBin(double bin_size) : bin(bin_size) {};
+  enum class Scale { Linear, Log };
+  static HistoFlatBin Linear(double width) { return HistoFlatBin(Scale::Linear, width); }
+  static HistoFlatBin Log(size_t bins_per_decade) { return HistoFlatBin(Scale::Log, 1.0 / bins_per_decade); }
+  static constexpr int64_t MaxDenseBins = 1 << 20;
+  HistoFlatBin(Scale _scale, double _width) : scale(_scale), width(_width), bins_per_decade(std::round(1.0 / _width)), key_begin(0), n_nonpositive(0), n_unbinned(0) {
+    if (!(width > 0.0)) { throw std::runtime_error("bin size must be positive"); }
+    if (scale == Scale::Log && (bins_per_decade < 1.0 || std::abs(bins_per_decade * width - 1.0) > 1.0e-12)) { throw std::runtime_error("the number of bins per decade must be an integer"); }
+  }
   void Add(double v) {
-    int key = val_to_binidx(v);
-    if( histo.find(key) == histo.end() ) { histo[key] = 0; }
-    histo[key]++;
+    if (scale == Scale::Log && v <= 0.0) { n_nonpositive++; return; }
+    int64_t key;
+    if (!ToKey(v, key)) { n_unbinned++; return; }
+    AddCount(key, 1);
+  }
+  // add the values in a range, e.g., ConstSpan<double> or std::vector<double>
+  template <class Range>
+  void AddMany(const Range& values) {
+    for (double v: values) { Add(v); }
+  }
+  // add value(x) for each x in [first, last), e.g., a component of the reputations of the entries
+  template <class Iterator, class F>
+  void AddMany(Iterator first, Iterator last, F value) {
+    for (; first != last; ++first) { Add(value(*first)); }
+  }
+  // Bins must be the same. The histograms are typically filled by threads and merged afterwards.
+  void Merge(const HistoFlatBin& other) {
+    if (scale != other.scale || width != other.width) { throw std::runtime_error("bin size must be same"); }
+    const int64_t first = other.FirstKey(), last = other.LastKey();
+    MergeCounts(first, other.counts.data() + (first - other.key_begin), last - first + 1, other.n_nonpositive, other.n_unbinned);
+    for (const auto& kv: other.sparse) { AddCount(kv.first, kv.second); }
+  }
+  // The first key, the numbers of the non-positive and the unbinned values, the number and the (key, count) pairs of the sparse bins,
+  // and the counts from the first to the last non-empty bin of the array, e.g., to be sent to another MPI rank as MPI_UINT64_T.
+  // The receiver merges them by MergePacked into a histogram of the same bins.
+  std::vector<uint64_t> Pack() const {
+    const int64_t first = FirstKey(), last = LastKey();
+    std::vector<uint64_t> packed = {static_cast<uint64_t>(first), n_nonpositive, n_unbinned, sparse.size()};
+    for (const auto& kv: sparse) { packed.insert(packed.end(), {static_cast<uint64_t>(kv.first), kv.second}); }
+    if (first <= last) { packed.insert(packed.end(), counts.begin() + (first - key_begin), counts.begin() + (last - key_begin + 1)); }
+    return packed;
+  }
+  void MergePacked(const uint64_t* packed, size_t size) {
+    if (size < 4 || (size - 4) / 2 < packed[3]) { throw std::runtime_error("invalid packed histogram"); }
+    const size_t n_sparse = packed[3];
+    MergeCounts(static_cast<int64_t>(packed[0]), packed + 4 + 2 * n_sparse, size - 4 - 2 * n_sparse, packed[1], packed[2]);
+    for (size_t i = 0; i < n_sparse; i++) { AddCount(static_cast<int64_t>(packed[4 + 2 * i]), packed[5 + 2 * i]); }
   }
+  // the left edge of each bin and the count divided by the bin size, from the first to the last non-empty bin of the array,
+  // and for each non-empty sparse bin. The bin size is in log10 scale for the log bins, i.e., the frequency is per decade.
   std::map<double,double> Frequency() const {
     std::map<double,double> result;
-    if (histo.empty()) { return result;}
-    int key_min = histo.begin()->first;
-    int key_max = histo.rbegin()->first;
-    for( int i = key_min; i <= key_max; i++ ) {
-      double val = binidx_to_val( i );
-      size_t n = ( histo.find(i) == histo.end() ) ? 0 : histo.at(i);
-      double freq = n / binidx_to_binsize( i );
-      result[val] = freq;
-    }
+    const double factor = (scale == Scale::Linear) ? 1.0 / width : bins_per_decade;
+    for (int64_t k = FirstKey(); k <= LastKey(); k++) { result[LeftEdge(k)] = counts[k - key_begin] * factor; }
+    for (const auto& kv: sparse) { result[LeftEdge(kv.first)] += kv.second * factor; }
     return result;
   }
-  void Merge(const HistoNormalBin& other) {
-    if (bin != other.bin) { throw std::runtime_error("bin size must be same"); }
-    for (auto kv : other.histo) {
-      if (histo.find(kv.first) == histo.end()) {
-        histo[kv.first] = kv.second;
-      }
-      else {
-        histo[kv.first] += kv.second;
-      }
-    }
+  uint64_t Total() const {
+    uint64_t n = n_nonpositive + n_unbinned;
+    for (uint64_t c: counts) { n += c; }
+    for (const auto& kv: sparse) { n += kv.second; }
+    return n;
   }
-  const double bin;
+  uint64_t NumNonPositive() const { return n_nonpositive; }
+  uint64_t NumUnbinned() const { return n_unbinned; }  // NaN, infinity, and the values beyond 2^61 bins
+  const Scale scale;
+  const double width;  // bin size, which is in log10 scale for the log bins
+
   private:
-  int val_to_binidx(double v) const {
-    return static_cast<int>( std::floor(v/bin) );
-  };
-  double binidx_to_val(int i) const {
-    return i * bin;
-  };
-  double binidx_to_binsize(int i) const {
-    return bin;
-  };
-  std::map<int, size_t> histo;
+  const double bins_per_decade;  // 1 / width, used for the log bins so that the edges at the powers of ten are exact
+  int64_t key_begin;  // key of counts[0]
+  std::vector<uint64_t> counts;
+  std::map<int64_t,uint64_t> sparse;  // the bins out of the array, which could not be covered within MaxDenseBins
+  uint64_t n_nonpositive;
+  uint64_t n_unbinned;
+  // returns false when the key is not representable, so that NaN and huge values are never converted to int64_t
+  bool ToKey(double v, int64_t& key) const {
+    const double k = std::floor( (scale == Scale::Linear) ? v / width : std::log10(v) * bins_per_decade );
+    if (!(std::abs(k) < 2.305843009213693952e18)) { return false; }  // 2^61, so that the differences of the keys do not overflow
+    key = static_cast<int64_t>(k);
+    return true;
+  }
+  void AddCount(int64_t key, uint64_t c) {
+    if (key < key_begin || key >= key_begin + static_cast<int64_t>(counts.size())) {
+      if (!Cover(key, key)) { sparse[key] += c; return; }
+    }
+    counts[key - key_begin] += c;
+  }
+  double LeftEdge(int64_t key) const {
+    return (scale == Scale::Linear) ? key * width : std::pow(10.0, key / bins_per_decade);
+  }
+  int64_t FirstKey() const {
+    for (size_t i = 0; i < counts.size(); i++) { if (counts[i] > 0) { return key_begin + i; } }
+    return key_begin;
+  }
+  int64_t LastKey() const {
+    for (size_t i = counts.size(); i > 0; i--) { if (counts[i-1] > 0) { return key_begin + i - 1; } }
+    return key_begin - 1;
+  }
+  void MergeCounts(int64_t first, const uint64_t* c, size_t n, uint64_t nonpositive, uint64_t unbinned) {
+    n_nonpositive += nonpositive;
+    n_unbinned += unbinned;
+    if (n == 0) { return; }
+    if (n > static_cast<size_t>(MaxDenseBins) || !Cover(first, first + static_cast<int64_t>(n) - 1)) {
+      for (size_t i = 0; i < n; i++) { if (c[i] > 0) { AddCount(first + static_cast<int64_t>(i), c[i]); } }
+      return;
+    }
+    for (size_t i = 0; i < n; i++) { counts[first - key_begin + i] += c[i]; }
+  }
+  // Extend the array to contain [first, last] with some margin so that it is not extended one bin at a time.
+  // Returns false without extending it when the array would exceed MaxDenseBins.
+  bool Cover(int64_t first, int64_t last) {
+    const int64_t end = key_begin + static_cast<int64_t>(counts.size());
+    if (!counts.empty() && first >= key_begin && last < end) { return true; }
+    const int64_t lo = counts.empty() ? first : std::min(first, key_begin), hi = counts.empty() ? last + 1 : std::max(last + 1, end);
+    if (hi - lo > MaxDenseBins) { return false; }
+    const int64_t margin = std::min<int64_t>(std::max<int64_t>(static_cast<int64_t>(counts.size()) / 2, 8), (MaxDenseBins - (hi - lo)) / 2);
+    const int64_t new_begin = counts.empty() ? first - margin : std::min(first - margin, key_begin);
+    const int64_t new_end = counts.empty() ? last + 1 + margin : std::max(last + 1 + margin, end);
+    std::vector<uint64_t> c(new_end - new_begin, 0);
+    if (!counts.empty()) { std::copy(counts.begin(), counts.end(), c.begin() + (key_begin - new_begin)); }
+    counts.swap(c);
+    key_begin = new_begin;
+    return true;
+  }
+};
+
+// histogram of linear bins of the given size
+class HistoNormalBin : public HistoFlatBin {
+  public:
+  HistoNormalBin(double bin_size) : HistoFlatBin(Scale::Linear, bin_size) {};
 };
 
-#endif // HISTO_NORMAL_BIN_HPP
\ No newline at end of file
+#endif // HISTO_NORMAL_BIN_HPP
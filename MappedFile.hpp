@@ -0,0 +1,71 @@
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <string>
+#include <algorithm>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+
+// Read-only memory mapping of a whole file. The pages are loaded on demand and shared among the processes on a node.
+class MappedFile {
+  public:
+  explicit MappedFile(const std::string& path) : addr(nullptr), size(0) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { throw std::runtime_error("failed to open file: " + path); }
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      ::close(fd);
+      throw std::runtime_error("failed to stat file: " + path);
+    }
+    size = static_cast<size_t>(st.st_size);
+    if (size > 0) {
+      void* p = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+      if (p == MAP_FAILED) {
+        ::close(fd);
+        throw std::runtime_error("failed to map file: " + path);
+      }
+      addr = static_cast<const char*>(p);
+    }
+    ::close(fd);
+  }
+  ~MappedFile() { if (addr) { ::munmap(const_cast<char*>(addr), size); } }
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+  const char* Data() const { return addr; }
+  size_t Size() const { return size; }
+  // hint that the file is read sequentially, so that the pages are read ahead and released early
+  void AdviseSequential() const { if (addr) { ::madvise(const_cast<char*>(addr), size, MADV_SEQUENTIAL); } }
+  // drop the pages in [begin, end) from the memory of the process. They are read again from the file when accessed.
+  void Release(size_t begin, size_t end) const {
+    const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+    begin = (begin + page - 1) / page * page;
+    end = std::min(end, size) / page * page;
+    if (addr && begin < end) { ::madvise(const_cast<char*>(addr) + begin, end - begin, MADV_DONTNEED); }
+  }
+
+  private:
+  const char* addr;
+  size_t size;
+};
+
+// non-owning view of an array, e.g., a column in the mapped pages
+template <typename T>
+class ConstSpan {
+  public:
+  ConstSpan(const T* _ptr, size_t _n) : ptr(_ptr), n(_n) {};
+  const T* data() const { return ptr; }
+  size_t size() const { return n; }
+  const T* begin() const { return ptr; }
+  const T* end() const { return ptr + n; }
+  const T& operator[](size_t i) const { return ptr[i]; }
+
+  private:
+  const T* ptr;
+  size_t n;
+};
+
+#endif  // MAPPED_FILE_HPP
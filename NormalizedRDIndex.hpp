@@ -0,0 +1,108 @@
+#ifndef NORMALIZED_RD_INDEX_HPP
+#define NORMALIZED_RD_INDEX_HPP
+
+#include <vector>
+#include <algorithm>
+#include <stdexcept>
+#include "Strategy.hpp"
+
+
+// Enumerates the normalized reputation dynamics, i.e., the representatives of the orbits under the permutations of reputations,
+// without storing their IDs. The IDs are divided into blocks of 729 and the number of normalized IDs preceding each block is tabulated.
+// Rank and Unrank thus take a binary search over the table and a scan of a single block.
+// The table covers the IDs in [id_begin, id_end), which are rounded to the blocks, and the indexes are counted from id_begin.
+class NormalizedRDIndex {
+  public:
+  static constexpr uint64_t NumRD = 387420489ull;  // 3^18
+  static constexpr uint64_t BlockSize = 729ull;    // 3^6
+  static constexpr uint64_t NumBlocks = NumRD / BlockSize;
+  NormalizedRDIndex(uint64_t id_begin = 0ull, uint64_t id_end = NumRD) {
+    if (id_begin > id_end || id_end > NumRD) { throw std::runtime_error("invalid range of ReputationDynamics IDs"); }
+    block_begin = id_begin / BlockSize;
+    SetOffsets(CountBlocks(block_begin, (id_end + BlockSize - 1) / BlockSize));
+  }
+  // index of the blocks from block_begin (an index of the blocks, not an ID) made of the numbers of normalized IDs in them,
+  // e.g., counted by CountBlocks in different processes
+  static NormalizedRDIndex FromBlockCounts(uint64_t block_begin, const std::vector<uint64_t>& block_counts) {
+    if (block_begin > NumBlocks || block_counts.size() > NumBlocks - block_begin) { throw std::runtime_error("invalid range of blocks"); }
+    NormalizedRDIndex index(0ull, 0ull);  // empty index, which costs no enumeration
+    index.block_begin = block_begin;
+    index.SetOffsets(block_counts);
+    return index;
+  }
+  // numbers of normalized IDs in the blocks [first, last), which are counted in parallel
+  static std::vector<uint64_t> CountBlocks(uint64_t first, uint64_t last) {
+    std::vector<uint64_t> counts(last - first);
+    #pragma omp parallel for schedule(dynamic, 256)
+    for (uint64_t b = first; b < last; b++) {
+      counts[b - first] = CountInBlock(b, BlockSize);
+    }
+    return counts;
+  }
+  uint64_t Size() const { return offsets.back(); }
+  uint64_t IdBegin() const { return block_begin * BlockSize; }
+  uint64_t IdEnd() const { return (block_begin + offsets.size() - 1) * BlockSize; }
+
+  // number of normalized IDs in [IdBegin(), rd_id). It is the index of rd_id when rd_id is normalized.
+  uint64_t Rank(uint64_t rd_id) const {
+    if (rd_id < IdBegin() || rd_id > IdEnd()) { throw std::out_of_range("ReputationDynamics ID is out of the index"); }
+    if (rd_id == IdEnd()) { return Size(); }
+    const uint64_t b = rd_id / BlockSize - block_begin;
+    return offsets[b] + CountInBlock(b + block_begin, rd_id % BlockSize);
+  }
+  // ID of the normalized ReputationDynamics at index idx
+  uint64_t Unrank(uint64_t idx) const {
+    if (idx >= Size()) { throw std::out_of_range("index of normalized ReputationDynamics is out of range"); }
+    const uint64_t b = BlockOf(idx);
+    uint64_t n = offsets[b];
+    for (uint64_t id = (b + block_begin) * BlockSize; ; id++) {
+      if (ReputationDynamics(id).IsNormalized()) {
+        if (n == idx) { return id; }
+        n++;
+      }
+    }
+  }
+  // IDs of the normalized ReputationDynamics at the indexes [offset, offset+count). The blocks are scanned in parallel.
+  std::vector<uint64_t> Slice(uint64_t offset, uint64_t count) const {
+    if (offset > Size() || count > Size() - offset) { throw std::out_of_range("slice of normalized ReputationDynamics is out of range"); }
+    std::vector<uint64_t> ans(count);
+    if (count == 0) { return ans; }
+    const uint64_t last = offset + count;
+    const uint64_t b0 = BlockOf(offset), b1 = BlockOf(last - 1);
+    #pragma omp parallel for schedule(dynamic, 16)
+    for (uint64_t b = b0; b <= b1; b++) {
+      uint64_t n = offsets[b];
+      const uint64_t id0 = (b + block_begin) * BlockSize;
+      for (uint64_t id = id0; id < id0 + BlockSize && n < last; id++) {
+        if (ReputationDynamics(id).IsNormalized()) {
+          if (n >= offset) { ans[n - offset] = id; }
+          n++;
+        }
+      }
+    }
+    return ans;
+  }
+
+  private:
+  uint64_t block_begin;
+  std::vector<uint64_t> offsets;  // offsets[b] is the number of normalized IDs in the blocks before b
+  void SetOffsets(const std::vector<uint64_t>& block_counts) {
+    offsets.assign(block_counts.size() + 1, 0ull);
+    for (size_t b = 0; b < block_counts.size(); b++) { offsets[b+1] = offsets[b] + block_counts[b]; }
+  }
+  // block containing the idx-th normalized ID
+  uint64_t BlockOf(uint64_t idx) const {
+    return static_cast<uint64_t>(std::upper_bound(offsets.begin(), offsets.end(), idx) - offsets.begin()) - 1;
+  }
+  // number of normalized IDs among the first n IDs of the block
+  static uint64_t CountInBlock(uint64_t block, uint64_t n) {
+    uint64_t count = 0;
+    const uint64_t id0 = block * BlockSize;
+    for (uint64_t id = id0; id < id0 + n; id++) {
+      if (ReputationDynamics(id).IsNormalized()) { count++; }
+    }
+    return count;
+  }
+};
+
+#endif  // NORMALIZED_RD_INDEX_HPP
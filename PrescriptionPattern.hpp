@@ -0,0 +1,108 @@
+#ifndef PRESCRIPTION_PATTERN_HPP
+#define PRESCRIPTION_PATTERN_HPP
+
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <stdexcept>
+#include "Strategy.hpp"
+
+
+// A list of prescription patterns compiled into the masks and the values of the bits of the prescription table of a strategy.
+// A strategy matches the list when it matches all the patterns. Examples of the patterns:
+//   GG:cG, GG:c*, GB:*B      action and the reputation of the donor after it
+//   GB:c[NG], GB:*[NG]       the reputation is one of those in the brackets
+//   GG:cG:B, GG:**:[NG]      the reputation after the alternative action is also specified
+//   GGd:B, BGd:[BN]          the reputation after the given action irrespective of the action rule
+// Since the reputations are stored as one-hot bits in the table, a set of reputations is a mask of the bits that must be zero,
+// and the match of a whole list takes two AND operations and two comparisons.
+class PrescriptionPattern {
+  public:
+  // For the pair of reputations i = 3 * donor + recipient, the first word has seven bits from 7*i, which are the action,
+  // the reputations after the action and after the alternative action.
+  // The second word has six bits from 6*i, which are the reputations after defection and after cooperation.
+  using table_t = std::array<uint64_t,2>;
+  static table_t Table(const Strategy& s) {
+    table_t t = {0ull, 0ull};
+    for (int i = 0; i < 9; i++) {
+      Reputation X = static_cast<Reputation>(i / 3), Y = static_cast<Reputation>(i % 3);
+      Action a = s.ar.ActAt(X, Y);
+      Reputation r_d = s.rd.RepAt(X, Y, Action::D), r_c = s.rd.RepAt(X, Y, Action::C);
+      Reputation r = (a == Action::C) ? r_c : r_d, r_not = (a == Action::C) ? r_d : r_c;
+      t[0] |= (static_cast<uint64_t>(a) | (OneHot(r) << 1) | (OneHot(r_not) << 4)) << (7 * i);
+      t[1] |= (OneHot(r_d) | (OneHot(r_c) << 3)) << (6 * i);
+    }
+    return t;
+  }
+
+  PrescriptionPattern(const std::vector<std::string>& patterns) : mask({0ull, 0ull}), value({0ull, 0ull}) {
+    for (const std::string& s: patterns) {
+      if (!Compile(s)) {
+        std::cerr << s << std::endl;
+        throw std::runtime_error("invalid pattern");
+      }
+    }
+  }
+  bool Match(const table_t& t) const { return (t[0] & mask[0]) == value[0] && (t[1] & mask[1]) == value[1]; }
+  bool Match(const Strategy& s) const { return Match(Table(s)); }
+
+  private:
+  table_t mask, value;
+  static constexpr uint64_t Never = 1ull << 63;  // a value bit outside of the table, which is set when the patterns contradict each other
+
+  static uint64_t OneHot(Reputation r) { return 1ull << static_cast<int>(r); }
+  static int ToRep(char c) {
+    if (c == 'B') { return 0; }
+    else if (c == 'N') { return 1; }
+    else if (c == 'G') { return 2; }
+    else { return -1; }
+  }
+  // parse a reputation, a set of reputations in brackets, or '*' into the one-hot bits of the excluded reputations
+  static bool ParseReps(const std::string& s, size_t& pos, bool allow_any, uint64_t& excluded) {
+    if (pos >= s.size()) { return false; }
+    uint64_t allowed = 0;
+    if (s[pos] == '*' && allow_any) { allowed = 7; pos++; }
+    else if (s[pos] == '[') {
+      for (pos++; pos < s.size() && ToRep(s[pos]) >= 0; pos++) { allowed |= 1ull << ToRep(s[pos]); }
+      if (pos >= s.size() || s[pos] != ']' || allowed == 0) { return false; }
+      pos++;
+    }
+    else if (ToRep(s[pos]) >= 0) { allowed = 1ull << ToRep(s[pos++]); }
+    else { return false; }
+    excluded = 7ull & ~allowed;
+    return true;
+  }
+  void Require(size_t w, uint64_t m, uint64_t v) {
+    if ((mask[w] & m & (value[w] ^ v)) != 0) { value[w] |= Never; }
+    mask[w] |= m;
+    value[w] |= v;
+  }
+  bool Compile(const std::string& s) {
+    if (s.size() < 5 || ToRep(s[0]) < 0 || ToRep(s[1]) < 0) { return false; }
+    const int i = 3 * ToRep(s[0]) + ToRep(s[1]);
+    size_t pos = 3;
+    uint64_t excluded = 0;
+    if (s[2] == 'c' || s[2] == 'd') {  // XYa:Z
+      if (s[3] != ':') { return false; }
+      pos = 4;
+      if (!ParseReps(s, pos, false, excluded) || pos != s.size()) { return false; }
+      Require(1, excluded << (6 * i + ((s[2] == 'c') ? 3 : 0)), 0ull);
+      return true;
+    }
+    if (s[2] != ':') { return false; }
+    if (s[pos] == 'c' || s[pos] == 'd') { Require(0, 1ull << (7 * i), static_cast<uint64_t>(s[pos] == 'c') << (7 * i)); }
+    else if (s[pos] != '*') { return false; }
+    pos++;
+    if (!ParseReps(s, pos, true, excluded)) { return false; }
+    Require(0, excluded << (7 * i + 1), 0ull);
+    if (pos == s.size()) { return true; }
+    if (s[pos] != ':') { return false; }
+    pos++;
+    if (!ParseReps(s, pos, true, excluded) || pos != s.size()) { return false; }
+    Require(0, excluded << (7 * i + 4), 0ull);
+    return true;
+  }
+};
+
+#endif  // PRESCRIPTION_PATTERN_HPP
@@ -0,0 +1,48 @@
+#ifndef RD_INDEX_FILE_HPP
+#define RD_INDEX_FILE_HPP
+
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <vector>
+#include "MappedFile.hpp"
+
+
+// Binary list of ReputationDynamics IDs, which is memory-mapped so that each process reads its own slice without copying.
+// The file consists of a 16-byte header, the magic "RDINDEX1" followed by the number of IDs, and the IDs as uint64_t in the native byte order.
+class RDIndexFile {
+  public:
+  explicit RDIndexFile(const std::string& path) : file(path) {
+    if (file.Size() < HeaderSize || !HasMagic(file.Data(), file.Size())) { throw std::runtime_error("not an RD index file: " + path); }
+    std::memcpy(&num, file.Data() + MagicSize, sizeof(num));
+    if (file.Size() != HeaderSize + num * sizeof(uint64_t)) { throw std::runtime_error("RD index file is truncated: " + path); }
+  }
+  uint64_t Size() const { return num; }
+  // pointer to the IDs. The header size is a multiple of 8, so the IDs are aligned in the mapped pages.
+  const uint64_t* Data() const { return reinterpret_cast<const uint64_t*>(file.Data() + HeaderSize); }
+
+  static bool IsRDIndexFile(const char* path) {
+    std::ifstream fin(path, std::ios::binary);
+    char buf[MagicSize];
+    return fin.read(buf, sizeof(buf)) && HasMagic(buf, sizeof(buf));
+  }
+  static void WriteHeader(std::ostream& out, uint64_t num) {
+    out.write(Magic(), MagicSize);
+    out.write(reinterpret_cast<const char*>(&num), sizeof(num));
+  }
+  static void WriteIDs(std::ostream& out, const std::vector<uint64_t>& ids) {
+    out.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(uint64_t));
+  }
+
+  private:
+  static const char* Magic() { return "RDINDEX1"; }
+  static constexpr size_t MagicSize = 8;
+  static constexpr size_t HeaderSize = MagicSize + sizeof(uint64_t);
+  static bool HasMagic(const char* p, size_t size) {
+    return size >= MagicSize && std::memcmp(p, Magic(), MagicSize) == 0;
+  }
+  MappedFile file;
+  uint64_t num;
+};
+
+#endif  // RD_INDEX_FILE_HPP
@@ -6,6 +6,8 @@
 #include <sstream>
 #include <vector>
 #include <array>
+#include <tuple>
+#include <cassert>
 #include <cstdint>
 
 
@@ -54,46 +56,89 @@ std::ostream &operator<<(std::ostream &os, const Reputation &rep) {
   return os;
 }
 
+// The six permutations of the reputations and the tables to apply them to the packed words of ActionRule and ReputationDynamics.
+// A permutation `map` relabels reputation X as map[X]. Both the packed words consist of three blocks for the donor's reputation,
+// and a permuted word is obtained by looking up each block in the table and moving it to the block of the relabeled donor.
+class ReputationPermutation {
+  public:
+  using map_t = std::array<int,3>;
+  static constexpr int NumMaps = 6;
+  // index of the map in Maps(). Returns -1 if it is not a permutation of {0,1,2}.
+  static int Index(const map_t& map) {
+    if (map[0] < 0 || map[0] > 2 || map[1] < 0 || map[1] > 2) { return -1; }
+    int k = 2 * map[0] + (map[1] > map[0] ? map[1] - 1 : map[1]);
+    return (map[2] == 3 - map[0] - map[1] && map[0] != map[1]) ? k : -1;
+  }
+  static map_t Map(int k) { const Table& t = Tables(); return {t.maps[k][0], t.maps[k][1], t.maps[k][2]}; }
+  // permute a 9-bit word of actions, where bit 3X+Y is the action of donor X to recipient Y
+  static uint16_t PermuteActions(int k, uint16_t bits) {
+    const Table& t = Tables();
+    uint16_t ans = 0;
+    for (int x = 0; x < 3; x++) { ans |= static_cast<uint16_t>(t.ar_row[k][(bits >> (3*x)) & 7u]) << (3*t.maps[k][x]); }
+    return ans;
+  }
+  // permute a 36-bit word of reputations, where bits [2i,2i+2) is the reputation at slot i = 6X+2Y+a
+  static uint64_t PermuteReputations(int k, uint64_t packed) {
+    const Table& t = Tables();
+    uint64_t ans = 0;
+    for (int x = 0; x < 3; x++) { ans |= static_cast<uint64_t>(t.rd_block[k][(packed >> (12*x)) & 0xFFFull]) << (12*t.maps[k][x]); }
+    return ans;
+  }
+
+  private:
+  struct Table {
+    int maps[6][3];             // in the lexicographic order, i.e., maps[0] is the identity
+    uint8_t ar_row[6][8];       // actions of a donor to recipients Y=0,1,2 -> those to the relabeled recipients
+    uint16_t rd_block[6][4096]; // reputations of a donor at (Y,a) -> relabeled reputations at the relabeled (Y,a)
+    constexpr Table() : maps(), ar_row(), rd_block() {
+      const int all[6][3] = { {0,1,2}, {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
+      for (int k = 0; k < 6; k++) {
+        for (int x = 0; x < 3; x++) { maps[k][x] = all[k][x]; }
+        for (int row = 0; row < 8; row++) {
+          int v = 0;
+          for (int y = 0; y < 3; y++) { v |= ((row >> y) & 1) << maps[k][y]; }
+          ar_row[k][row] = static_cast<uint8_t>(v);
+        }
+        for (int block = 0; block < 4096; block++) {
+          int v = 0;
+          for (int f = 0; f < 6; f++) {
+            int y = f / 2, a = f % 2;
+            int z = (block >> (2*f)) & 3;
+            int z_new = (z < 3) ? maps[k][z] : 3;
+            v |= z_new << (2 * (2 * maps[k][y] + a));
+          }
+          rd_block[k][block] = static_cast<uint16_t>(v);
+        }
+      }
+    }
+  };
+  static const Table& Tables() { static constexpr Table t; return t; }
+};
+
+// An action rule is stored as a 9-bit word, whose i-th bit is the action of a donor of reputation i/3 to a recipient of i%3.
+// Thus, the word is identical to the ID.
 class ActionRule {
   public:
-  ActionRule(const std::array<Action,9>& acts) : actions(acts) {};
+  ActionRule(const std::array<Action,9>& acts) : bits(0) {
+    for (size_t i = 0; i < 9; i++) { bits |= static_cast<uint16_t>(acts[i]) << i; }
+  };
   ActionRule(uint64_t id) {
     if (id >= 512) { throw std::runtime_error("invalid ID for ActionRule"); }
-    for (size_t i = 0; i < 9; i++) {
-      if (id & (1ul << i)) { actions[i] = static_cast<Action>(1); }
-      else { actions[i] = static_cast<Action>(0); }
-    }
+    bits = static_cast<uint16_t>(id);
   }
-  ActionRule Clone() const { return ActionRule(actions); }
+  ActionRule Clone() const { return ActionRule(ID()); }
   Action ActAt(const Reputation& rep_d, const Reputation& rep_r) const {
-    size_t idx = 0;
-    idx += static_cast<size_t>(rep_d) * 3;
-    idx += static_cast<size_t>(rep_r);
-    return actions[idx];
+    size_t idx = static_cast<size_t>(rep_d) * 3 + static_cast<size_t>(rep_r);
+    return static_cast<Action>((bits >> idx) & 1u);
   }
   void SetAction(const Reputation& rep_d, const Reputation& rep_r, const Action& act) {
-    size_t idx = 0;
-    idx += static_cast<size_t>(rep_d) * 3;
-    idx += static_cast<size_t>(rep_r);
-    actions[idx] = act;
+    size_t idx = static_cast<size_t>(rep_d) * 3 + static_cast<size_t>(rep_r);
+    bits = (bits & ~(1u << idx)) | (static_cast<uint16_t>(act) << idx);
   }
   ActionRule Permute(std::array<int,3> map) const {
-    {
-      auto a = map; std::sort(a.begin(), a.end());
-      assert(a[0] == 0 && a[1] == 1 && a[2] == 2);
-    }
-    ActionRule new_ar(0);
-    for (int i = 0; i < 3; i++) {
-      Reputation X = static_cast<Reputation>(i);
-      Reputation X_new = static_cast<Reputation>(map[i]);
-      for (int j = 0; j < 3; j++) {
-        Reputation Y = static_cast<Reputation>(j);
-        Reputation Y_new = static_cast<Reputation>(map[j]);
-        Action A = ActAt(X, Y);
-        new_ar.SetAction(X_new, Y_new, A);
-      }
-    }
-    return new_ar;
+    int k = ReputationPermutation::Index(map);
+    assert(k >= 0);
+    return ActionRule(ReputationPermutation::PermuteActions(k, bits));
   }
 
   std::string Inspect() const {
@@ -102,105 +147,75 @@ class ActionRule {
     for (size_t i = 0; i < 9; i++) {
       Reputation rep_d = static_cast<Reputation>(i / 3);
       Reputation rep_r = static_cast<Reputation>(i % 3);
-      ss << "(" << rep_d << "->" << rep_r << ") : " << actions[i];
+      ss << "(" << rep_d << "->" << rep_r << ") : " << ActAt(rep_d, rep_r);
       if (i % 3 == 2) { ss << std::endl; }
       else { ss << "\t"; }
     }
     return ss.str();
   }
 
-  uint64_t ID() const {
-    int ans = 0;
-    for (size_t i = 0; i < 9; i++) {
-      ans += static_cast<uint64_t>(actions[i]) << i;
-    }
-    return ans;
-  }
+  uint64_t ID() const { return bits; }
 
   bool IsSecondOrder() const {
-    bool ans = true;
-    for (size_t i = 0; i < 3; i++) {
-      Reputation rep_r = static_cast<Reputation>(i);
-      Action a = ActAt(Reputation::B, rep_r);
-      Action b = ActAt(Reputation::N, rep_r);
-      Action c = ActAt(Reputation::G, rep_r);
-      if (a != b || b != c) {
-        ans = false;
-        break;
-      }
-    }
-    return ans;
+    // the actions do not depend on the donor's reputation, i.e., the three rows of 3 bits are identical
+    uint16_t row = bits & 7u;
+    return ((bits >> 3) & 7u) == row && ((bits >> 6) & 7u) == row;
   }
 
-  std::array<Action,9> actions;
+  private:
+  uint16_t bits;
 };
 
 bool operator==(const ActionRule& t1, const ActionRule& t2) { return t1.ID() == t2.ID(); }
 bool operator!=(const ActionRule& t1, const ActionRule& t2) { return !(t1 == t2); }
 
+// A reputation dynamics is stored as a 36-bit word, where the reputation at slot i = 6*donor + 2*recipient + action occupies bits [2i, 2i+2).
+// The ID is the same slots read as an 18-digit base-3 number. The conversions between them are done six digits at a time using the tables below.
 class ReputationDynamics {
   public:
-  ReputationDynamics(const std::array<Reputation,18>& reps) : reputations(reps) {};
+  ReputationDynamics(const std::array<Reputation,18>& reps) : packed(0) {
+    for (size_t i = 0; i < 18; i++) { packed |= static_cast<uint64_t>(reps[i]) << (2*i); }
+  };
   ReputationDynamics(uint64_t id) {
     // 3^18 = 387420489
     if (id >= 387420489ull) { throw std::runtime_error("invalid ID for ReputationDynamics"); }
-    for (size_t i = 0; i < 18; i++) {
-      reputations[i] = static_cast<Reputation>(id % 3);
-      id /= 3;
-    }
+    packed = PackedFromID(id);
   }
-  ReputationDynamics Clone() const { return ReputationDynamics(reputations); }
+  ReputationDynamics Clone() const { return FromPacked(packed); }
+  static ReputationDynamics FromPacked(uint64_t packed) { ReputationDynamics rd(0); rd.packed = packed; return rd; }
+  uint64_t Packed() const { return packed; }
   ReputationDynamics Permute(std::array<int,3> map) const {
-    {
-      auto a = map; std::sort(a.begin(), a.end());
-      assert(a[0] == 0 && a[1] == 1 && a[2] == 2);
-    }
-    ReputationDynamics new_rd(0);
-    for (int i = 0; i < 3; i++) {
-      Reputation X = static_cast<Reputation>(i);
-      Reputation X_new = static_cast<Reputation>(map[i]);
-      for (int j = 0; j < 3; j++) {
-        Reputation Y = static_cast<Reputation>(j);
-        Reputation Y_new = static_cast<Reputation>(map[j]);
-        Reputation Z = RepAt(X, Y, Action::C);
-        Reputation Z_new = static_cast<Reputation>( map[static_cast<int>(Z)] );
-        new_rd.SetRep(X_new, Y_new, Action::C, Z_new);
-        Z = RepAt(X, Y, Action::D);
-        Z_new = static_cast<Reputation>( map[static_cast<int>(Z)] );
-        new_rd.SetRep(X_new, Y_new, Action::D, Z_new);
-      }
-    }
-    return new_rd;
+    int k = ReputationPermutation::Index(map);
+    assert(k >= 0);
+    return FromPacked(ReputationPermutation::PermuteReputations(k, packed));
   }
+  // The normalized one has the largest ID among the permuted ones.
+  // Since the most significant base-3 digit of the ID is in the highest field, the packed words are in the same order as the IDs.
   std::pair<ReputationDynamics,std::array<int,3>> Normalized() const {
-    using map_t = std::array<int,3>;
-    std::vector<map_t> maps = { {0,2,1}, {1,0,2}, {1,2,0}, {2,0,1}, {2,1,0} };
-    size_t max = ID();
-    ReputationDynamics ans = (*this);
-    map_t m_max = {0,1,2};
-    for (const auto& m : maps) {
-      ReputationDynamics t = Permute(m);
-      if (t.ID() > max) {
-        max = t.ID();
-        ans = t;
-        m_max = m;
+    uint64_t max = packed;
+    int k_max = 0;
+    for (int k = 1; k < ReputationPermutation::NumMaps; k++) {
+      uint64_t t = ReputationPermutation::PermuteReputations(k, packed);
+      if (t > max) {
+        max = t;
+        k_max = k;
       }
     }
-    return std::make_pair(ans, m_max);
+    return std::make_pair(FromPacked(max), ReputationPermutation::Map(k_max));
+  }
+  bool IsNormalized() const {
+    for (int k = 1; k < ReputationPermutation::NumMaps; k++) {
+      if (ReputationPermutation::PermuteReputations(k, packed) > packed) { return false; }
+    }
+    return true;
   }
   Reputation RepAt(const Reputation& rep_d, const Reputation& rep_r, const Action& act) const {
-    size_t idx = 0;
-    idx += static_cast<size_t>(rep_d) * 6;
-    idx += static_cast<size_t>(rep_r) * 2;
-    idx += static_cast<size_t>(act);
-    return reputations[idx];
+    size_t idx = static_cast<size_t>(rep_d) * 6 + static_cast<size_t>(rep_r) * 2 + static_cast<size_t>(act);
+    return static_cast<Reputation>((packed >> (2*idx)) & 3ull);
   }
   void SetRep(const Reputation& rep_d, const Reputation& rep_r, const Action& act, const Reputation& new_rep) {
-    size_t idx = 0;
-    idx += static_cast<size_t>(rep_d) * 6;
-    idx += static_cast<size_t>(rep_r) * 2;
-    idx += static_cast<size_t>(act);
-    reputations[idx] = new_rep;
+    size_t idx = static_cast<size_t>(rep_d) * 6 + static_cast<size_t>(rep_r) * 2 + static_cast<size_t>(act);
+    packed = (packed & ~(3ull << (2*idx))) | (static_cast<uint64_t>(new_rep) << (2*idx));
   }
 
   std::string Inspect() const {
@@ -210,50 +225,57 @@ class ReputationDynamics {
       Reputation rep_d = static_cast<Reputation>(i / 6);
       Reputation rep_r = static_cast<Reputation>((i/2) % 3);
       Action act = static_cast<Action>(i % 2);
-      ss << "(" << rep_d << "->" << rep_r << "," << act << ") : " << reputations[i];
+      ss << "(" << rep_d << "->" << rep_r << "," << act << ") : " << RepAt(rep_d, rep_r, act);
       if (i % 6 == 5) { ss << std::endl; }
       else { ss << "\t"; }
     }
     return ss.str();
   }
 
-  uint64_t ID() const {
-    int ans = 0;
-    size_t i = 17;
-    while(true) {
-      ans *= 3;
-      ans += static_cast<int>(reputations[i]);
-      if (i == 0) break;
-      i--;
-    }
-    return ans;
-  }
+  uint64_t ID() const { return IDFromPacked(packed); }
 
   bool IsSecondOrder() const {
-    bool ans = true;
-    for (size_t i = 0; i < 6; i++) {
-      Reputation rep_r = static_cast<Reputation>(i/2);
-      Action act = static_cast<Action>(i % 2);
-      Reputation a = RepAt(Reputation::B, rep_r, act);
-      Reputation b = RepAt(Reputation::N, rep_r, act);
-      Reputation c = RepAt(Reputation::G, rep_r, act);
-      if (a != b || b != c) {
-        ans = false;
-        break;
-      }
-    }
-    return ans;
+    // the reputations do not depend on the donor's reputation, i.e., the three blocks of 12 bits are identical
+    uint64_t block = packed & 0xFFFull;
+    return ((packed >> 12) & 0xFFFull) == block && ((packed >> 24) & 0xFFFull) == block;
   }
 
-  std::array<Reputation,18> reputations;
+  static uint64_t PackedFromID(uint64_t id) {
+    const Base3Table& t = Table();
+    uint64_t d0 = id % 729ull, d1 = (id / 729ull) % 729ull, d2 = id / 531441ull;
+    return static_cast<uint64_t>(t.packed[d0]) | (static_cast<uint64_t>(t.packed[d1]) << 12) | (static_cast<uint64_t>(t.packed[d2]) << 24);
+  }
+  static uint64_t IDFromPacked(uint64_t packed) {
+    const Base3Table& t = Table();
+    return static_cast<uint64_t>(t.base3[packed & 0xFFFull])
+      + 729ull * t.base3[(packed >> 12) & 0xFFFull]
+      + 531441ull * t.base3[(packed >> 24) & 0xFFFull];
+  }
+
+  private:
+  uint64_t packed;
+  // conversion between six base-3 digits and six 2-bit fields
+  struct Base3Table {
+    uint16_t packed[729];   // base-3 value of six digits -> 12-bit word
+    uint16_t base3[4096];   // 12-bit word -> base-3 value (the words containing the field 3 are not used)
+    constexpr Base3Table() : packed(), base3() {
+      for (uint16_t v = 0; v < 729; v++) {
+        uint16_t w = 0, x = v;
+        for (int i = 0; i < 6; i++) { w |= (x % 3) << (2*i); x /= 3; }
+        packed[v] = w;
+        base3[w] = v;
+      }
+    }
+  };
+  static const Base3Table& Table() { static constexpr Base3Table t; return t; }
 };
-bool operator==(const ReputationDynamics& t1, const ReputationDynamics& t2) { return t1.ID() == t2.ID(); }
+bool operator==(const ReputationDynamics& t1, const ReputationDynamics& t2) { return t1.Packed() == t2.Packed(); }
 bool operator!=(const ReputationDynamics& t1, const ReputationDynamics& t2) { return !(t1 == t2); }
 
 // Strategy is a set of ReputationDynamics & ActionRule
 class Strategy {
   public:
-  Strategy(const ReputationDynamics& rep_d, const ActionRule& act_r) : rd(rep_d.ID()), ar(act_r.ID()) {};
+  Strategy(const ReputationDynamics& rep_d, const ActionRule& act_r) : rd(rep_d), ar(act_r) {};
   Strategy(uint64_t id) : rd(id>>9ull), ar(id&511ull) {};
   ReputationDynamics rd;
   ActionRule ar;
@@ -0,0 +1,90 @@
+#ifndef TRANSITION_TENSOR_HPP
+#define TRANSITION_TENSOR_HPP
+
+#include <array>
+#include "Strategy.hpp"
+
+
+// probabilities of the reputation transitions compiled from a pair of ReputationDynamics and ActionRule.
+// c[9X+3Y+Z] is the probability that a donor of reputation X gets reputation Z after an interaction with a recipient of reputation Y,
+// taking into account the implementation error mu_e and the assignment error mu_a.
+class TransitionTensor {
+  public:
+  using v3d_t = std::array<double,3>;
+  TransitionTensor(double mu_e, double mu_a, const ReputationDynamics& rd, const ActionRule& ar) {
+    for (int i = 0; i < 3; i++) {
+      Reputation X = static_cast<Reputation>(i);
+      for (int j = 0; j < 3; j++) {
+        Reputation Y = static_cast<Reputation>(j);
+        for (int k = 0; k < 3; k++) {
+          Reputation Z = static_cast<Reputation>(k);
+          int b1 = (rd.RepAt(X, Y, ar.ActAt(X, Y)) == Z) ? 1 : 0;
+          int b2 = (rd.RepAt(X, Y, Action::D) == Z) ? 1 : 0;
+          c[9*i+3*j+k] = (1.0-1.5*mu_a)*((1.0-mu_e)*b1+ mu_e*b2) + 0.5*mu_a;
+        }
+      }
+    }
+  }
+  double At(int i, int j, int k) const { return c[9*i+3*j+k]; }
+  std::array<double,27> c;
+  // the first and the second derivatives of c with respect to log s at s = 1, when both of the error rates are multiplied by s
+  static std::array<std::array<double,27>,2> LogErrorRateDerivatives(double mu_e, double mu_a, const ReputationDynamics& rd, const ActionRule& ar) {
+    std::array<std::array<double,27>,2> dc;
+    for (int i = 0; i < 3; i++) {
+      Reputation X = static_cast<Reputation>(i);
+      for (int j = 0; j < 3; j++) {
+        Reputation Y = static_cast<Reputation>(j);
+        for (int k = 0; k < 3; k++) {
+          Reputation Z = static_cast<Reputation>(k);
+          int b1 = (rd.RepAt(X, Y, ar.ActAt(X, Y)) == Z) ? 1 : 0;
+          int b2 = (rd.RepAt(X, Y, Action::D) == Z) ? 1 : 0;
+          // c is bilinear in (mu_e, mu_a), and d/d(log s) = mu_e d/dmu_e + mu_a d/dmu_a
+          double d1 = mu_e * (1.0-1.5*mu_a)*(b2-b1) + mu_a * (0.5 - 1.5*((1.0-mu_e)*b1 + mu_e*b2));
+          dc[0][9*i+3*j+k] = d1;
+          dc[1][9*i+3*j+k] = d1 - 3.0 * mu_e * mu_a * (b2-b1);
+        }
+      }
+    }
+    return dc;
+  }
+};
+
+// time derivative of the reputations of the residents: dh_k/dt = -h_k + sum_{i,j} h_i h_j c_ijk
+struct ResidentFlux {
+  using v3d_t = TransitionTensor::v3d_t;
+  explicit ResidentFlux(const TransitionTensor& _t) : t(_t) {};
+  const TransitionTensor& t;
+  v3d_t operator()(const v3d_t& ht) const {
+    v3d_t ht_dot = {-ht[0], -ht[1], -ht[2]};
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) {
+          ht_dot[k] += ht[i] * ht[j] * t.c[9*i+3*j+k];
+        }
+      }
+    }
+    return ht_dot;
+  }
+};
+
+// time derivative of the reputations of mutants interacting with residents of reputations h_res:
+//   dh_k/dt = -h_k + sum_{i,j} h_i h_res_j c_ijk
+struct MutantFlux {
+  using v3d_t = TransitionTensor::v3d_t;
+  MutantFlux(const TransitionTensor& _t, const v3d_t& _h_res) : t(_t), h_res(_h_res) {};
+  const TransitionTensor& t;
+  const v3d_t& h_res;
+  v3d_t operator()(const v3d_t& ht) const {
+    v3d_t ht_dot = {-ht[0], -ht[1], -ht[2]};
+    for (int i = 0; i < 3; i++) {
+      for (int j = 0; j < 3; j++) {
+        for (int k = 0; k < 3; k++) {
+          ht_dot[k] += ht[i] * h_res[j] * t.c[9*i+3*j+k];
+        }
+      }
+    }
+    return ht_dot;
+  }
+};
+
+#endif // TRANSITION_TENSOR_HPP
@@ -0,0 +1,49 @@
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <string>
+#include <cmath>
+#include <icecream.hpp>
+#include "Entry.hpp"
+
+
+// Converts ESS_ids between the text format and the binary format of EntryFile.
+// The input may be in any format accepted by Entry::Load. The output is binary when its name ends with ".bin".
+int main(int argc, char* argv[]) {
+  bool sort = false;
+  if (argc >= 2 && std::string(argv[1]) == "-s") {
+    sort = true;
+    argc--;
+    argv++;
+  }
+  if (argc != 3 && argc != 6) {
+    std::cerr << "wrong number of arguments" << std::endl;
+    std::cerr << "  usage: " << argv[0] << " [-s] <input ESS_ids> <output ESS_ids> [mu_e mu_a benefit]" << std::endl;
+    std::cerr << "    -s : sort the entries by gid and remove the duplicates" << std::endl;
+    throw std::runtime_error("wrong number of arguments");
+  }
+
+  std::vector<Entry> entries = sort ? Entry::LoadAndUniqSort(argv[1]) : Entry::Load(argv[1]);
+  bool sorted = sort;
+  double mu_e = NAN, mu_a = NAN, benefit = NAN;
+  if (EntryFile::IsEntryFile(argv[1])) {
+    EntryFile in(argv[1]);
+    sorted = sorted || in.IsSorted();
+    mu_e = in.MuE(); mu_a = in.MuA(); benefit = in.Benefit();
+  }
+  if (argc == 6) {
+    mu_e = std::stod(argv[3]); mu_a = std::stod(argv[4]); benefit = std::stod(argv[5]);
+  }
+
+  const std::string out_path(argv[2]);
+  if (out_path.size() >= 4 && out_path.compare(out_path.size() - 4, 4, ".bin") == 0) {
+    EntryFile::Write(argv[2], entries, sorted, mu_e, mu_a, benefit);
+  }
+  else {
+    std::ofstream fout(argv[2]);
+    for (const Entry& e: entries) { fout << e << "\n"; }
+  }
+  std::cerr << entries.size() << " entries" << std::endl;
+
+  return 0;
+}
@@ -2,31 +2,49 @@
 #include <fstream>
 #include <vector>
 #include <tuple>
+#include <string>
+#include <sstream>
+#include <cstdio>
 #include <icecream.hpp>
 #include "Entry.hpp"
+#include "EntryStream.hpp"
 
 
 int main(int argc, char* argv[]) {
-  if (argc != 3) {
+  // with "-s", the files are sorted by gid, e.g., the outputs of sort_uniq_ESS, so that they are streamed instead of loaded
+  bool presorted = (argc == 4 && std::string(argv[1]) == "-s");
+  if (argc != 3 && !presorted) {
     std::cerr << "wrong number of arguments" << std::endl;
-    std::cerr << "  usage: " << argv[0] << " <ESS_ids_file1> <ESS_ids_file2>" << std::endl;
+    std::cerr << "  usage: " << argv[0] << " [-s] <ESS_ids_file1> <ESS_ids_file2>" << std::endl;
     throw std::runtime_error("wrong number of arguments");
   }
 
-  std::vector<Entry> inputs1 = Entry::LoadAndUniqSort(argv[1]), inputs2 = Entry::LoadAndUniqSort(argv[2]);
+  const std::vector<std::string> files = {argv[argc-2], argv[argc-1]};
+  SortedEntrySets sets(files, presorted);
+  MembershipCounts counts(2);
 
-  std::vector<Entry> left_only, right_only;
-
-  std::set_difference(inputs1.begin(), inputs1.end(), inputs2.begin(), inputs2.end(), std::inserter(left_only, left_only.end()));
-  std::set_difference(inputs2.begin(), inputs2.end(), inputs1.begin(), inputs1.end(), std::inserter(right_only, right_only.end()));
-
-  for(const auto& in: left_only) {
-    std::cout << "< " << in << "\n";
-  }
-  for(const auto& in: right_only) {
-    std::cout << "> " << in << "\n";
-  }
-  std::cerr << "size: < " << left_only.size() << ", > " << right_only.size() << "\n";
+  // The files are merged in a single pass. The norms only in the left are printed while merging, and those only in the right
+  // are printed afterwards. The latter are buffered in memory up to 1 MB, and the rest is spilled to a temporary file.
+  std::FILE* right = std::tmpfile();
+  if (!right) { throw std::runtime_error("failed to create a temporary file"); }
+  std::ostringstream right_buf;
+  const std::streamoff max_buffer = 1 << 20;
+  sets.Merge([right,&right_buf,max_buffer](const Entry& e, const std::vector<size_t>& inputs) {
+    if (inputs.size() != 1) { return; }
+    if (inputs[0] == 0) { std::cout << "< " << e << "\n"; return; }
+    right_buf << "> " << e << "\n";
+    if (right_buf.tellp() >= max_buffer) {
+      const std::string str = right_buf.str();
+      if (std::fwrite(str.data(), 1, str.size(), right) != str.size()) { throw std::runtime_error("failed to write a temporary file"); }
+      right_buf.str("");
+    }
+  }, &counts);
+  std::rewind(right);
+  char chunk[1 << 16];
+  for (size_t n; (n = std::fread(chunk, 1, sizeof(chunk), right)) > 0; ) { std::cout.write(chunk, n); }
+  std::fclose(right);
+  std::cout << right_buf.str();
+  std::cerr << "size: < " << counts.only_in[0] << ", > " << counts.only_in[1] << ", common: " << counts.multiplicity[2] << "\n";
 
   return 0;
-}
\ No newline at end of file
+}
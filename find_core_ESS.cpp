@@ -3,28 +3,52 @@
 #include <vector>
 #include <array>
 #include <tuple>
+#include <string>
+#include <algorithm>
 #include <icecream.hpp>
 #include "Entry.hpp"
+#include "EntryStream.hpp"
 
 
 int main(int argc, char* argv[]) {
-  if (argc <= 2) {
-    std::cerr << "wrong number of arguments" << std::endl;
-    std::cerr << "  usage: " << argv[0] << " <ESS_ids_file1> <ESS_ids_file2> ...." << std::endl;
-    throw std::runtime_error("wrong number of arguments");
+  // -s : the files are sorted by gid, e.g., the outputs of sort_uniq_ESS, so that they are streamed instead of loaded
+  // -k <k> : print the norms found in at least k files instead of all the files. "-k 1" gives the union.
+  // -d : print the norms found only in the first file, i.e., the difference between the first file and the others
+  bool presorted = false, difference = false, k_given = false;
+  size_t k = 0;
+  std::string error;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg == "-s") { presorted = true; }
+    else if (arg == "-d") { difference = true; }
+    else if (arg == "-k") {
+      const std::string val = (i + 1 < argc) ? argv[++i] : "";
+      k_given = true;
+      if (val.empty() || val.size() > 9 || !std::all_of(val.begin(), val.end(), [](char c) { return c >= '0' && c <= '9'; })) { error = "invalid k: " + val; }
+      else { k = std::stoul(val); }
+    }
+    else { files.push_back(arg); }
   }
-
-  std::vector<Entry> v = Entry::LoadAndUniqSort(argv[1]);
-
-  for (int i = 2; i < argc; i++) {
-    std::vector<Entry> v2 = Entry::LoadAndUniqSort(argv[i]);
-    std::vector<Entry> result;
-    std::set_intersection(v.begin(), v.end(), v2.begin(), v2.end(), std::inserter(result, result.end()));
-    v = result;
+  if (error.empty()) {
+    if (files.size() < 2) { error = "wrong number of arguments"; }
+    else if (k_given && (k == 0 || k > files.size())) { error = "k must be between 1 and the number of the files"; }
+    else if (k_given && difference) { error = "-k and -d cannot be given together"; }
   }
-
-  for(const auto& x: v) {
-    std::cout << x << "\n";
+  if (!error.empty()) {
+    std::cerr << error << std::endl;
+    std::cerr << "  usage: " << argv[0] << " [-s] [-k <k> | -d] <ESS_ids_file1> <ESS_ids_file2> ...." << std::endl;
+    throw std::runtime_error(error);
   }
+  if (!k_given) { k = files.size(); }
+
+  SortedEntrySets sets(files, presorted);
+  MembershipCounts counts(files.size());
+  sets.Merge([k,difference](const Entry& e, const std::vector<size_t>& inputs) {
+    const bool selected = difference ? (inputs.size() == 1 && inputs[0] == 0) : (inputs.size() >= k);
+    if (selected) { std::cout << e << "\n"; }
+  }, &counts);
+  counts.Print(std::cerr, files);
+
   return 0;
-}
\ No newline at end of file
+}
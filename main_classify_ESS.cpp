@@ -2,6 +2,8 @@
 #include <vector>
 #include <array>
 #include <map>
+#include <memory>
+#include <unordered_map>
 #include <set>
 #include <algorithm>
 #include <chrono>
@@ -13,107 +15,27 @@
 
 #include "Strategy.hpp"
 #include "Game.hpp"
+#include "ErrorRateContinuation.hpp"
 #include "HistoNormalBin.hpp"
 #include "Entry.hpp"
+#include "EntryStream.hpp"
+#include "PrescriptionPattern.hpp"
 
 
-// return unmatched pattern
-std::string Match(const Game& g, const std::vector<std::string>& patterns) {
-  const auto c2r = [](char c)->Reputation {
-    if (c == 'B') { return Reputation::B; }
-    else if (c == 'N') { return Reputation::N; }
-    else if (c == 'G') { return Reputation::G; }
-    else { throw std::runtime_error("unknown reputation"); }
-  };
-  const auto c2a = [](char c)->Action {
-    if (c == 'c') { return Action::C; }
-    else if (c == 'd') { return Action::D; }
-    else { throw std::runtime_error("unknown action"); }
-  };
-  const auto IsIn = [&c2r](Reputation rep, const std::string& set_str)->bool {
-    for (char c: set_str) {
-      if (rep == c2r(c)) { return true; }
-    }
-    return false;
-  };
-  // examples:
-  // 1. GG:cG, GG:c*, GB:*B
-  // 2. GGd:B
-  // 3. GB:c[NG], GB:*[NG]
-  // 4. BGd:[BN]
-  // 5. GG:cG:B, GG:c*:B, GG:*G:B, GG:**:B
-  // 6. GG:cG:[NG]
-  // 7. GG:c[GN]:B
-  // 8. GG:c[BN]:[NG]
-  const std::regex re1(R"([BNG][BNG]:[cd\*][BNG\*])");
-  const std::regex re2(R"([BNG][BNG][cd]:[BNG])");
-  const std::regex re3(R"([BNG][BNG]:[cd\*]\[([BNG]+)\])");
-  const std::regex re4(R"([BNG][BNG][cd]:\[([BNG]+)\])");
-  const std::regex re5(R"([BNG][BNG]:[cd\*][BNG\*]:[BNG])");
-  const std::regex re6(R"([BNG][BNG]:[cd\*][BNG\*]:\[([BNG]+)\])");
-  const std::regex re7(R"([BNG][BNG]:[cd\*]\[([BNG]+)\]:([BNG]))");
-  const std::regex re8(R"([BNG][BNG]:[cd\*]\[([BNG]+)\]:\[([BNG]+)\])");
-  for (const std::string& s: patterns) {
-    std::smatch m;
-    if (std::regex_match(s, re1)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (s[4] != '*' && std::get<1>(p) != c2r(s[4])) { return s; }
-    }
-    else if (std::regex_match(s, re2)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]), Z = c2r(s[4]);
-      Action a = c2a(s[2]);
-      if (g.strategy.rd.RepAt(X, Y, a) != Z) { return s; }
-    }
-    else if (std::regex_match(s, m, re3)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (!IsIn( std::get<1>(p), m[1].str()) ) { return s; }
-    }
-    else if (std::regex_match(s, m, re4)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      Action a = c2a(s[2]);
-      Reputation Z = g.strategy.rd.RepAt(X, Y, a);
-      if ( !IsIn(Z, m[1].str()) ) { return s; }
-    }
-    else if (std::regex_match(s, re5)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (s[4] != '*' && std::get<1>(p) != c2r(s[4])) { return s; }
-      Action a_not = (std::get<0>(p) == Action::C) ? Action::D : Action::C;
-      if (g.strategy.rd.RepAt(X,Y,a_not) != c2r(s[6])) { return s; }
-    }
-    else if (std::regex_match(s, m, re6)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (s[4] != '*' && std::get<1>(p) != c2r(s[4])) { return s; }
-      if ( !IsIn(std::get<2>(p), m[1].str()) ) { return s; }
-    }
-    else if (std::regex_match(s, m, re7)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (!IsIn(std::get<1>(p), m[1].str())) { return s; }
-      if (std::get<2>(p) != c2r(m[2].str()[0]) ) { return s; }
-    }
-    else if (std::regex_match(s, m, re8)) {
-      Reputation X = c2r(s[0]), Y = c2r(s[1]);
-      auto p = g.At(X, Y);
-      if (s[3] != '*' && std::get<0>(p) != c2a(s[3])) { return s; }
-      if (!IsIn(std::get<1>(p), m[1].str())) { return s; }
-      if (!IsIn(std::get<2>(p), m[2].str())) { return s; }
-    }
-    else {
-      std::cerr << s << std::endl;
-      throw std::runtime_error("invalid pattern");
+// A list of prescription patterns, compiled at the first call, and the key and the description given when it matches.
+// The cases are tested in order, and a case with no pattern always matches.
+struct PatternCase {
+  PrescriptionPattern pattern;
+  std::string key, desc;
+};
+void ClassifyByPatterns(const PrescriptionPattern::table_t& t, const std::vector<PatternCase>& cases, std::string& key, std::string& desc) {
+  for (const PatternCase& c: cases) {
+    if (c.pattern.Match(t)) {
+      key += c.key;
+      desc += c.desc;
+      return;
     }
-
   }
-  return std::string();
 }
 
 
@@ -123,196 +45,107 @@ std::string ClassifyType(uint64_t game_id) {
 
   std::string desc = "", key = "";
 
-  Game g(1.0e-3, 1.0e-3, game_id);
-  Game::v3d_t H_3 = g.ResidentEqReputation();
-  Game g_5(1.0e-5, 1.0e-5, game_id);
-  Game::v3d_t H_5 = g_5.ResidentEqReputation();
-
-  const double hN_exponent = (std::log10(H_3[1]) - std::log10(H_5[1])) / 2.0;
-  const double hB_exponent = (std::log10(H_3[0]) - std::log10(H_5[0])) / 2.0;
-  const double defect_level_exponent = (std::log10(1.0 - g.ResidentCoopProb()) - std::log10(1.0 - g_5.ResidentCoopProb())) / 2.0;
+  const ErrorRateContinuation continuation(game_id);
+  const ErrorRateContinuation::Point eq3 = continuation.SolveAt({1.0e-3, 1.0e-3});
+  Game g(1.0e-3, 1.0e-3, game_id, eq3.coop_prob, eq3.h_star);
   const double tol = 0.05;
 
   if (g.ResidentCoopProb() < 0.99) {
     return "C0. partial cooperation";
   }
+
+  // The exponents are estimated from the local scaling at mu = 1e-3.
+  // When the correction to the leading order is O(mu^gamma), the exponents from the two points and the asymptotic ones deviate from the local ones
+  // at most by |curvature| / gamma. Taking gamma >= 1/2, the local ones are used unless such a deviation may cross a boundary of the classes.
+  // Otherwise, h* at mu = 1e-5 is continued from the one at mu = 1e-3, and the exponents are calculated from the two points.
+  const ErrorRateContinuation::Scaling local = continuation.LocalScaling(eq3);
+  double hN_exponent = local.exponent[1], hB_exponent = local.exponent[0], defect_level_exponent = local.exponent[3];
+  auto is_decisive = [&local,tol](int n)->bool {
+    const double margin = 3.0 * std::abs(local.curvature[n]) + 0.005;
+    if (!std::isfinite(local.exponent[n]) || !std::isfinite(margin)) { return false; }
+    for (double center: {0.0, 0.33, 0.5, 0.67, 1.0}) {
+      if (std::abs(std::abs(local.exponent[n] - center) - tol) < margin) { return false; }
+    }
+    return true;
+  };
+  // the defect level vanishing at mu = 1e-3 is left to the two points, which also gives NaN when it vanishes at mu = 1e-5
+  if ( 1.0 - eq3.coop_prob < 1.0e-9 || !is_decisive(0) || !is_decisive(1) || !is_decisive(3) ) {
+    const ErrorRateContinuation::Point eq5 = continuation.SolveFrom(eq3, {1.0e-5, 1.0e-5});
+    hN_exponent = (std::log10(eq3.h_star[1]) - std::log10(eq5.h_star[1])) / 2.0;
+    hB_exponent = (std::log10(eq3.h_star[0]) - std::log10(eq5.h_star[0])) / 2.0;
+    defect_level_exponent = (std::log10(1.0 - eq3.coop_prob) - std::log10(1.0 - eq5.coop_prob)) / 2.0;
+  }
+
   if ( std::abs(defect_level_exponent - 1.0) >= tol ) {
     IC(defect_level_exponent, g.ID());
     return "C01. unexpected defect_level scaling";
   }
 
 
-  auto classify_by_recovery_C1 = [&g,&desc,&key]() {
+  const PrescriptionPattern::table_t t = PrescriptionPattern::Table(g.strategy);
+
+  auto classify_by_recovery_C1 = [&t,&desc,&key]() {
     // how B recover G in C1 norms
-    if (
-      Match(g, {"BG:cG", "NG:*G"}).empty()
-      )
-    {
-      key += "R11.";
-      desc += ", BG:cG NG:*G (R11: B->G,N->G)";
-    }
-    else if (
-      Match(g, {"BG:cG", "NG:*B"}).empty()
-      )
-    {
-      key += "R12.";
-      desc += ", BG:cG NG:*B (R12: N->B->G)";
-    }
-    else if (
-      Match(g, {"BG:cN", "NG:cG"}).empty()
-      )
-    {
-      key += "R21.";
-      desc += ", BG:cN NG:cG (R21: B->N->G,cc)";
-    }
-    else if (
-      Match(g, {"BG:cN", "NG:dG"}).empty()
-      )
-    {
-      key += "R22.";
-      desc += ", BG:cN NG:dG (R22: B->N->G,cd)";
-    }
-    else if (
-      Match(g, {"BG:dN", "NG:cG"}).empty()
-      )
-    {
-      key += "R23.";
-      desc += ", BG:dN NG:cG (R23: B->N->G,dc)";
-    }
-    else if (
-      Match(g, {"BG:*N", "NG:cN", "NN:*G"}).empty()
-      )
-    {
-      key += "R24.";
-      desc += ", BG:*N NG:cN NN:*G (R24: B->N,NN->G,dc)";
-    }
-    else {
-      key += "99.";
-    }
+    static const std::vector<PatternCase> cases = {
+      {{{"BG:cG", "NG:*G"}}, "R11.", ", BG:cG NG:*G (R11: B->G,N->G)"},
+      {{{"BG:cG", "NG:*B"}}, "R12.", ", BG:cG NG:*B (R12: N->B->G)"},
+      {{{"BG:cN", "NG:cG"}}, "R21.", ", BG:cN NG:cG (R21: B->N->G,cc)"},
+      {{{"BG:cN", "NG:dG"}}, "R22.", ", BG:cN NG:dG (R22: B->N->G,cd)"},
+      {{{"BG:dN", "NG:cG"}}, "R23.", ", BG:dN NG:cG (R23: B->N->G,dc)"},
+      {{{"BG:*N", "NG:cN", "NN:*G"}}, "R24.", ", BG:*N NG:cN NN:*G (R24: B->N,NN->G,dc)"},
+      {{{}}, "99.", ""}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
 
-  auto classify_by_punishment_C1 = [&g,&desc,&key]() {
-    if (
-      Match(g, {"GB:dG"}).empty()
-      )
-    {
-      key += "P1.";
-      desc += ", GB:dG (P1: G punisher is justified)";
-    }
-    else if (
-      Match(g, {"GB:dN", "GN:dG"}).empty()
-      )
-    {
-      key += "P21.";
-      desc += ", GB:dN GN:dG (P21: G punisher becomes N, N is punished by G)";
-    }
-    else if (
-      Match(g, {"GB:dN", "GN:cG"}).empty()
-      )
-    {
-      key += "P22.";
-      desc += ", GB:dN GN:cG (P22: G punisher becomes N, N is cooperated by G)";
-    }
-    else if (
-      Match(g, {"GB:dN", "GN:cN", "NG:cG", "NN:*G"}).empty()
-      )
-    {
-      key += "P23.";
-      desc += ", GB:dN GN:cN NG:cG NN:*G (P23: G punisher becomes N, GN:cN, NG:cG & NN:*G)";
-    }
-    else {
-      key += "99.";
-    }
+  auto classify_by_punishment_C1 = [&t,&desc,&key]() {
+    static const std::vector<PatternCase> cases = {
+      {{{"GB:dG"}}, "P1.", ", GB:dG (P1: G punisher is justified)"},
+      {{{"GB:dN", "GN:dG"}}, "P21.", ", GB:dN GN:dG (P21: G punisher becomes N, N is punished by G)"},
+      {{{"GB:dN", "GN:cG"}}, "P22.", ", GB:dN GN:cG (P22: G punisher becomes N, N is cooperated by G)"},
+      {{{"GB:dN", "GN:cN", "NG:cG", "NN:*G"}}, "P23.", ", GB:dN GN:cN NG:cG NN:*G (P23: G punisher becomes N, GN:cN, NG:cG & NN:*G)"},
+      {{{}}, "99.", ""}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
 
-  auto classify_by_recovery_C2 = [&g,&desc,&key]() {
+  auto classify_by_recovery_C2 = [&t,&desc,&key]() {
     // how B recover G in C1 norms
-    if (
-      Match(g, {"BG:cG"}).empty()
-      )
-    {
-      key += "R1.";
-      desc += ", BG:cG (R1: B->G)";
-    }
-    else if (
-      Match(g, {"BG:cN"}).empty()
-      )
-    {
-      key += "R2.";
-      desc += ", BG:cN (R2: B->N)";
-    }
-    else {
-      key += "99.";
-    }
+    static const std::vector<PatternCase> cases = {
+      {{{"BG:cG"}}, "R1.", ", BG:cG (R1: B->G)"},
+      {{{"BG:cN"}}, "R2.", ", BG:cN (R2: B->N)"},
+      {{{}}, "99.", ""}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
-  auto classify_by_punishment_C2 = [&g,&desc,&key]() {
-    if (
-      Match(g, {"GB:dG"}).empty()
-      )
-    {
-      key += "P1.";
-      desc += ", GB:dG (P1: G punisher is justified)";
-    }
-    else if (
-      Match(g, {"GB:dN"}).empty()
-      )
-    {
-      key += "P2.";
-      desc += ", GB:dN (P21: G punisher becomes N)";
-    }
-    else {
-      key += "99.";
-    }
+  auto classify_by_punishment_C2 = [&t,&desc,&key]() {
+    static const std::vector<PatternCase> cases = {
+      {{{"GB:dG"}}, "P1.", ", GB:dG (P1: G punisher is justified)"},
+      {{{"GB:dN"}}, "P2.", ", GB:dN (P21: G punisher becomes N)"},
+      {{{}}, "99.", ""}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
 
-  auto classify_by_recovery_path_C3 = [&g,&desc,&key]() {
+  auto classify_by_recovery_path_C3 = [&t,&desc,&key]() {
     // recovery path
-    if (
-      Match(g, {"BG:c[GN]:B", "BN:c[GN]:B"}).empty()
-      ) {
-      key += "R1.";
-      desc += ", B[GN]:c[GN]:B (R1: B cooperates G&N)";
-    } else if (
-      Match(g, {"BG:c[GN]:B", "BN:dB:B"}).empty()
-      ) {
-      key += "R21.";
-      desc += ", BN:dB:B or BG:c[GN]:B (R21: B cooperates with G but not with N)";
-    } else if (
-      Match(g, {"BG:dB:B", "BN:c[GN]:B"}).empty()
-      ) {
-      key += "R22.";
-      desc += ", BN:c[GN]:B or BG:dB:B (R22: B cooperates with N but not with G)";
-    } else {
-      key += "99.";
-      desc += ", unknown recovery pattern";
-    }
+    static const std::vector<PatternCase> cases = {
+      {{{"BG:c[GN]:B", "BN:c[GN]:B"}}, "R1.", ", B[GN]:c[GN]:B (R1: B cooperates G&N)"},
+      {{{"BG:c[GN]:B", "BN:dB:B"}}, "R21.", ", BN:dB:B or BG:c[GN]:B (R21: B cooperates with G but not with N)"},
+      {{{"BG:dB:B", "BN:c[GN]:B"}}, "R22.", ", BN:c[GN]:B or BG:dB:B (R22: B cooperates with N but not with G)"},
+      {{{}}, "99.", ", unknown recovery pattern"}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
 
-  auto classify_by_punishment_C3 = [&g,&desc,&key]() {  // for type2, classify of punisher
-    if (
-      Match(g, {"GB:d[GN]", "NB:d[GN]"}).empty()
-      )
-    {
-      key += "P1.";
-      desc += ", GB:d[GN] NB:d[GN] (P1: both GN punishers are justified)";
-    }
-    else if (
-      Match(g, {"GB:d[GN]", "NB:dB"}).empty()
-      )
-    {
-      key += "P21.";
-      desc += ", GB:d[NG] NB:dB (P21: N pusniher is not justified)";
-    }
-    else if (
-      Match(g, {"GB:dB", "NB:d[GN]"}).empty()
-      )
-    {
-      key += "P22.";
-      desc += ", GB:dB, NB:d[GN] (P22: G punisher is not justified)";
-    }
-    else {
-      key += "99.";
-    }
+  auto classify_by_punishment_C3 = [&t,&desc,&key]() {  // for type2, classify of punisher
+    static const std::vector<PatternCase> cases = {
+      {{{"GB:d[GN]", "NB:d[GN]"}}, "P1.", ", GB:d[GN] NB:d[GN] (P1: both GN punishers are justified)"},
+      {{{"GB:d[GN]", "NB:dB"}}, "P21.", ", GB:d[NG] NB:dB (P21: N pusniher is not justified)"},
+      {{{"GB:dB", "NB:d[GN]"}}, "P22.", ", GB:dB, NB:d[GN] (P22: G punisher is not justified)"},
+      {{{}}, "99.", ""}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
   };
 
   // C1
@@ -326,32 +159,13 @@ std::string ClassifyType(uint64_t game_id) {
   else if (
     std::abs(hN_exponent - 0.5) < tol && std::abs(hB_exponent - 1.0) < tol
     ) {
-    if (
-      Match(g, {"GG:cG", "GN:cG", "NG:cN", "NN:*G"}).empty()
-      )
-    {
-      key += "C21.";
-      desc += "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cG,NG:cN,NN:*G)";
-    }
-    else if (
-      Match(g, {"GG:cG", "GN:cN", "NG:cG", "NN:*G"}).empty()
-      )
-    {
-      key += "C22.";
-      desc += "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cN,NG:cG,NN:*G)";
-    }
-    else if (
-      Match(g, {"GG:cG", "GN:cN", "NG:cG", "NN:*B"}).empty()
-      )
-    {
-      key += "C23.";
-      desc += "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cN,NG:cG,NN:*B)";
-    }
-    else {
-      key += "C29.";
-      desc += "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu))";
-
-    }
+    static const std::vector<PatternCase> cases = {
+      {{{"GG:cG", "GN:cG", "NG:cN", "NN:*G"}}, "C21.", "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cG,NG:cN,NN:*G)"},
+      {{{"GG:cG", "GN:cN", "NG:cG", "NN:*G"}}, "C22.", "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cN,NG:cG,NN:*G)"},
+      {{{"GG:cG", "GN:cN", "NG:cG", "NN:*B"}}, "C23.", "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu), GG:cG,GN:cN,NG:cG,NN:*B)"},
+      {{{}}, "C29.", "h_N=O(mu^1/2),h_B=O(mu) (C2: N~sqrt(mu))"}
+    };
+    ClassifyByPatterns(t, cases, key, desc);
 
     classify_by_punishment_C2();
     classify_by_recovery_C2();
@@ -383,50 +197,145 @@ std::string ClassifyType(uint64_t game_id) {
 }
 
 
-struct Output {
-  std::map<std::string, std::vector<Entry>> map_type_inputs;
-  using histo3_t = std::array<HistoNormalBin,3>;
-  std::map<std::string,histo3_t> MakeHistoH() const {
-    std::map<std::string, histo3_t> h_histos;
-    for (auto kv: map_type_inputs) {
-      std::string type = kv.first;
-      const double bin = 0.01;
-      h_histos.insert( std::make_pair(type, histo3_t({bin, bin, bin})));
-      for (const Entry& in : kv.second) {
-        h_histos.at(type).at(0).Add(in.h.at(0));
-        h_histos.at(type).at(1).Add(in.h.at(1));
-        h_histos.at(type).at(2).Add(in.h.at(2));
-      }
+// Statistics of the strategies of a class, which are accumulated entry by entry so that the entries do not have to be kept in memory.
+// Each thread accumulates its own statistics, and they are merged at the end.
+struct ClassStats {
+  // histograms of h_B, h_N, and h_G in linear bins, and of h_B and h_N in log bins since they scale with powers of mu
+  struct HistoH {
+    std::array<HistoNormalBin,3> linear = {{ {0.01}, {0.01}, {0.01} }};
+    std::array<HistoFlatBin,2> log = {{ HistoFlatBin::Log(10), HistoFlatBin::Log(10) }};
+    void Add(const Entry& in) {
+      for (int i = 0; i < 3; i++) { linear[i].Add(in.h[i]); }
+      for (int i = 0; i < 2; i++) { log[i].Add(in.h[i]); }
     }
-    return std::move(h_histos);
-  }
-  void Merge(const Output& other) {
-    for (auto kv: other.map_type_inputs) {
-      map_type_inputs[kv.first].insert(map_type_inputs[kv.first].begin(), kv.second.begin(), kv.second.end());
+    void Merge(const HistoH& other) {
+      for (int i = 0; i < 3; i++) { linear[i].Merge(other.linear[i]); }
+      for (int i = 0; i < 2; i++) { log[i].Merge(other.log[i]); }
+    }
+  };
+  uint64_t count = 0;
+  // for each pair of the reputations of the donor and the recipient, the histograms of the action, the reputation after the action,
+  // and the reputation after the other action
+  std::array<std::array<uint64_t,2>,9> next_act = {};
+  std::array<std::array<uint64_t,3>,9> next_rep = {}, other_rep = {};
+  std::map<std::string,uint64_t> order_count = {{"BNG", 0}, {"BGN", 0}, {"NBG", 0}, {"NGB", 0}, {"GBN", 0}, {"GNB", 0}};  // orders of the continuation payoffs
+  HistoH h_histo;
+
+  void Add(const Entry& input) {
+    count++;
+    const Game g(0.001, 0.001, input.gid);
+    for (size_t n = 0; n < 9; n++) {
+      Reputation donor = static_cast<Reputation >(n/3);
+      Reputation recip = static_cast<Reputation >(n%3);
+      auto p = g.At(donor, recip);
+      next_act[n][static_cast<int>(std::get<0>(p))]++;
+      next_rep[n][static_cast<int>(std::get<1>(p))]++;
+      other_rep[n][static_cast<int>(std::get<2>(p))]++;
     }
+
+    const Game g2(0.02, 0.02, input.gid, input.c_prob, input.h);
+    auto cont = g2.ContinuationPayoff(0.5, 2.0, 1.0, 0.02);
+    if (cont[0] <= cont[1] && cont[1] <= cont[2]) { order_count.at("BNG") += 1; }
+    else if(cont[0] <= cont[2] && cont[2] <= cont[1]) { order_count.at("BGN") += 1; }
+    else if(cont[1] <= cont[0] && cont[0] <= cont[2]) { order_count.at("NBG") += 1; }
+    else if(cont[1] <= cont[2] && cont[2] <= cont[0]) { order_count.at("NGB") += 1; }
+    else if(cont[2] <= cont[0] && cont[0] <= cont[1]) { order_count.at("GBN") += 1; }
+    else if(cont[2] <= cont[1] && cont[1] <= cont[0]) { order_count.at("GNB") += 1; }
+    else { IC(cont); throw std::runtime_error("must not happen"); }
+
+    h_histo.Add(input);
   }
-  void SortByID() {
-    for (auto kv: map_type_inputs) {
-      std::sort(kv.second.begin(), kv.second.end());
+  void Merge(const ClassStats& other) {
+    count += other.count;
+    for (size_t n = 0; n < 9; n++) {
+      for (int i = 0; i < 2; i++) { next_act[n][i] += other.next_act[n][i]; }
+      for (int i = 0; i < 3; i++) {
+        next_rep[n][i] += other.next_rep[n][i];
+        other_rep[n][i] += other.other_rep[n][i];
+      }
     }
+    for (const auto& kv: other.order_count) { order_count.at(kv.first) += kv.second; }
+    h_histo.Merge(other.h_histo);
   }
 };
+using stats_map_t = std::map<std::string,ClassStats>;  // statistics of each type
+
+// Entries grouped by their types, which are filled by the threads concurrently.
+// A type is given a compact ID when it first appears, and each thread appends the entries to its own buffer for the ID.
+// Thus, the threads share nothing but the table of the IDs, which is looked up only when a thread meets a type for the first time.
+class ClassifiedEntries {
+  public:
+  explicit ClassifiedEntries(size_t num_threads) : buffers(num_threads), id_caches(num_threads) {};
+  void Add(size_t thread, const std::string& type, const Entry& e) {
+    std::vector<std::vector<Entry>>& b = buffers[thread];
+    const uint32_t id = TypeID(thread, type);
+    if (id >= b.size()) { b.resize(id + 1); }
+    b[id].push_back(e);
+  }
+  // Gather the buffers of each type into a vector sorted by gid. The types are processed in parallel, and the buffers are released.
+  // Since the inputs are sorted and each thread processes them in the ascending order, the buffers are sorted runs merged in linear time.
+  std::map<std::string, std::vector<Entry>> Merge() {
+    std::vector<std::vector<Entry>> merged(names.size());
+    #pragma omp parallel for shared(merged) default(none) schedule(dynamic, 1)
+    for (size_t id = 0; id < merged.size(); id++) {
+      size_t total = 0;
+      for (const auto& b: buffers) { total += (id < b.size()) ? b[id].size() : 0; }
+      std::vector<Entry>& v = merged[id];
+      v.reserve(total);
+      std::vector<size_t> bounds = {0};
+      for (auto& b: buffers) {
+        if (id >= b.size() || b[id].empty()) { continue; }
+        if (!std::is_sorted(b[id].begin(), b[id].end())) { std::sort(b[id].begin(), b[id].end()); }
+        v.insert(v.end(), b[id].begin(), b[id].end());
+        std::vector<Entry>().swap(b[id]);
+        bounds.push_back(v.size());
+      }
+      // merge the adjacent pairs of the runs until a single run remains
+      while (bounds.size() > 2) {
+        std::vector<size_t> next = {0};
+        for (size_t r = 0; r + 1 < bounds.size(); r += 2) {
+          if (r + 2 < bounds.size()) {
+            std::inplace_merge(v.begin() + bounds[r], v.begin() + bounds[r+1], v.begin() + bounds[r+2]);
+            next.push_back(bounds[r+2]);
+          }
+          else { next.push_back(bounds[r+1]); }
+        }
+        bounds.swap(next);
+      }
+    }
+    std::map<std::string, std::vector<Entry>> ans;
+    for (size_t id = 0; id < merged.size(); id++) { ans[names[id]] = std::move(merged[id]); }
+    return ans;
+  }
 
-void PrintHistogramPrescriptions(const std::vector<Entry>& inputs) {
-  std::vector< std::array<size_t,2> > histo_next_act(9, {0,0});
-  std::vector< std::array<size_t,3> > histo_next_rep(9, {0, 0, 0});
-  std::vector< std::array<size_t,3> > histo_other_rep(9, {0, 0, 0});
-  for (const Entry& input: inputs) {
-    Game g(0.001, 0.001, input.gid);
-    for (size_t n = 0; n < 9; n++) {
-      Reputation donor = static_cast<Reputation >(n/3);
-      Reputation recip = static_cast<Reputation >(n%3);
-      auto p = g.At(donor, recip);
-      histo_next_act[n][static_cast<int>(std::get<0>(p))]++;
-      histo_next_rep[n][static_cast<int>(std::get<1>(p))]++;
-      histo_other_rep[n][static_cast<int>(std::get<2>(p))]++;
+  private:
+  std::vector<std::vector<std::vector<Entry>>> buffers;  // buffers[thread][type ID]
+  std::vector<std::unordered_map<std::string,uint32_t>> id_caches;  // the IDs already known to each thread
+  std::map<std::string,uint32_t> ids;
+  std::vector<std::string> names;  // names[type ID]
+  uint32_t TypeID(size_t thread, const std::string& type) {
+    auto found = id_caches[thread].find(type);
+    if (found != id_caches[thread].end()) { return found->second; }
+    uint32_t id;
+    #pragma omp critical (classified_entries_ids)
+    {
+      auto it = ids.find(type);
+      if (it != ids.end()) { id = it->second; }
+      else {
+        id = static_cast<uint32_t>(names.size());
+        ids.emplace(type, id);
+        names.push_back(type);
+      }
     }
+    id_caches[thread].emplace(type, id);
+    return id;
   }
+};
+
+void PrintHistogramPrescriptions(const ClassStats& stats) {
+  const auto& histo_next_act = stats.next_act;
+  const auto& histo_next_rep = stats.next_rep;
+  const auto& histo_other_rep = stats.other_rep;
 
   // print results
   std::cout << "       :        d       c|       B       N       G|       B       N       G" << std::endl;
@@ -447,43 +356,29 @@ void PrintHistogramPrescriptions(const std::vector<Entry>& inputs) {
   }
 }
 
-void PrintContinuationPayoffOrders(const std::vector<Entry>& inputs) {
-  std::map<std::string,int> order_count = {{"BNG", 0}, {"BGN", 0}, {"NBG", 0}, {"NGB", 0}, {"GBN", 0}, {"GNB", 0}};
-  for (const Entry& input: inputs) {
-    Game g(0.02, 0.02, input.gid, input.c_prob, input.h);
-    auto cont = g.ContinuationPayoff(0.5, 2.0, 1.0, 0.02);
-    if (cont[0] <= cont[1] && cont[1] <= cont[2]) { order_count.at("BNG") += 1; }
-    else if(cont[0] <= cont[2] && cont[2] <= cont[1]) { order_count.at("BGN") += 1; }
-    else if(cont[1] <= cont[0] && cont[0] <= cont[2]) { order_count.at("NBG") += 1; }
-    else if(cont[1] <= cont[2] && cont[2] <= cont[0]) { order_count.at("NGB") += 1; }
-    else if(cont[2] <= cont[0] && cont[0] <= cont[1]) { order_count.at("GBN") += 1; }
-    else if(cont[2] <= cont[1] && cont[1] <= cont[0]) { order_count.at("GNB") += 1; }
-    else { IC(cont); throw std::runtime_error("must not happen"); }
-  }
+void PrintContinuationPayoffOrders(const ClassStats& stats) {
   std::cout << "reputation order:\n";
-  for (const auto& kv: order_count) {
+  for (const auto& kv: stats.order_count) {
     if (kv.second > 0) {
       std::cout << "  " << kv.first << ": " << kv.second << "\n";
     }
   }
 }
 
-void PrintHHisto(const std::array<HistoNormalBin,3>& h_histo) {
-  assert( h_histo.size() == 3 );
-  std::cout << "H_B histo:" << std::endl;
-  auto histo0 = h_histo[0].Frequency();
-  for (const auto &keyval : histo0) {
-    std::cout << keyval.first << ' ' << keyval.second << std::endl;
-  }
-  std::cout << "H_N histo:" << std::endl;
-  auto histo1 = h_histo[1].Frequency();
-  for (const auto &keyval : histo1) {
-    std::cout << keyval.first << ' ' << keyval.second << std::endl;
+void PrintHHisto(const ClassStats::HistoH& h_histo) {
+  const std::array<std::string,3> names = {"H_B", "H_N", "H_G"};
+  for (int i = 0; i < 3; i++) {
+    std::cout << names[i] << " histo:" << std::endl;
+    for (const auto &keyval : h_histo.linear[i].Frequency()) {
+      std::cout << keyval.first << ' ' << keyval.second << std::endl;
+    }
+    if (h_histo.linear[i].NumUnbinned() > 0) { std::cout << "# " << h_histo.linear[i].NumUnbinned() << " values are not binned (NaN, infinite, or too large)" << std::endl; }
   }
-  std::cout << "H_G histo:" << std::endl;
-  auto histo2 = h_histo[2].Frequency();
-  for (const auto &keyval : histo2) {
-    std::cout << keyval.first << ' ' << keyval.second << std::endl;
+  for (int i = 0; i < 2; i++) {
+    std::cout << names[i] << " histo (log10 bins, per decade):" << std::endl;
+    for (const auto &keyval : h_histo.log[i].Frequency()) {
+      std::cout << keyval.first << ' ' << keyval.second << std::endl;
+    }
   }
 }
 
@@ -499,28 +394,34 @@ std::string ExtractKeyFromType(const std::string& type) {
   }
 }
 
-int main(int argc, char* argv[]) {
-
-  if (argc != 2) {
-    std::cerr << "wrong number of arguments" << std::endl;
-    std::cerr << "  usage: " << argv[0] << " <new_ESS_ids_file>" << std::endl;
-    throw std::runtime_error("wrong number of arguments");
+// Files ESS_<key> of the classes. A file is opened when the first entry of the class is written, and the lines are buffered by the stream.
+class ClassWriters {
+  public:
+  void Write(const std::string& type, const Entry& e) {
+    auto found = files.find(type);
+    if (found == files.end()) {
+      const std::string path = std::string("ESS_") + ExtractKeyFromType(type);
+      std::unique_ptr<std::ofstream> fout(new std::ofstream(path));
+      if (!*fout) {
+        std::cerr << "Failed to open file: " << path << std::endl;
+        throw std::runtime_error("failed to open file");
+      }
+      found = files.emplace(type, std::move(fout)).first;
+    }
+    *found->second << e << '\n';
   }
+  private:
+  std::map<std::string, std::unique_ptr<std::ofstream>> files;
+};
 
-  std::vector<Entry> inputs = Entry::LoadAndUniqSort(argv[1]);
-
-  int num_threads;
-  #pragma omp parallel shared(num_threads) default(none)
-  { num_threads = omp_get_num_threads(); };
-
-  std::cerr << "num_threads: " << num_threads << std::endl;
-
-  std::vector<Output> outs(num_threads);
-
-  #pragma omp parallel for shared(inputs,outs,std::cerr) default(none) schedule(dynamic, 1000)
-  for (size_t i = 0; i < inputs.size(); i++) {
-    if (inputs.size() > 20 && i % (inputs.size()/20) == 0) { std::cerr << "progress: " << (i*100)/inputs.size() << " %" << std::endl; }
-    Entry input = inputs[i];
+// Classify the entries in parallel and accumulate the statistics of each type in stats[thread].
+// c_prob and h are calculated again when they are missing. f(i, thread, type) is called for each entry after entries[i] is updated.
+template <class F>
+void ClassifyEntries(std::vector<Entry>& entries, std::vector<stats_map_t>& stats, bool show_progress, F f) {
+  #pragma omp parallel for shared(entries,stats,show_progress,f,std::cerr) default(none) schedule(dynamic, 64)
+  for (size_t i = 0; i < entries.size(); i++) {
+    if (show_progress && entries.size() > 20 && i % (entries.size()/20) == 0) { std::cerr << "progress: " << (i*100)/entries.size() << " %" << std::endl; }
+    Entry& input = entries[i];
     std::string type = ClassifyType(input.gid);
     if (input.c_prob == -1.0) {
       // we need to calculate probs again
@@ -528,39 +429,100 @@ int main(int argc, char* argv[]) {
       input.c_prob = g.ResidentCoopProb();
       input.h = g.ResidentEqReputation();
     }
-    int th = omp_get_thread_num();
-    outs[th].map_type_inputs[type].emplace_back(input);
+    const int th = omp_get_thread_num();
+    stats[th][type].Add(input);
+    f(i, th, type);
   }
+}
 
-  Output out;
-  for (size_t i = 0; i < num_threads; i++) {
-    out.Merge( outs[i] );
+stats_map_t MergeStats(const std::vector<stats_map_t>& stats) {
+  stats_map_t merged;
+  for (const stats_map_t& m: stats) {
+    for (const auto& kv: m) { merged[kv.first].Merge(kv.second); }
   }
-  out.SortByID();
+  return merged;
+}
 
-  for (auto kv: out.map_type_inputs) {
-    std::cout << "type: " << kv.first << ", " << kv.second.size() << std::endl;
+void PrintStats(const stats_map_t& stats) {
+  for (const auto& kv: stats) {
+    std::cout << "type: " << kv.first << ", " << kv.second.count << std::endl;
   }
-
-  auto histo_map = out.MakeHistoH();
-  for (auto kv: out.map_type_inputs) {
+  for (const auto& kv: stats) {
     std::cout << "=================== TYPE " << kv.first << "====================" << std::endl;
     PrintHistogramPrescriptions(kv.second);
     PrintContinuationPayoffOrders(kv.second);
-    PrintHHisto(histo_map.at(kv.first));
+    PrintHHisto(kv.second.h_histo);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  // -s : the file is sorted by gid, e.g., the output of sort_uniq_ESS, so that it is streamed instead of loaded
+  // -c <chunk_size> : number of the entries read and classified at a time in the streaming mode
+  bool presorted = false;
+  size_t chunk_size = 100000;
+  std::vector<std::string> files;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg == "-s") { presorted = true; }
+    else if (arg == "-c" && i + 1 < argc) { chunk_size = std::stoul(argv[++i]); }
+    else { files.push_back(arg); }
+  }
+  if (files.size() != 1 || chunk_size == 0) {
+    std::cerr << "wrong number of arguments" << std::endl;
+    std::cerr << "  usage: " << argv[0] << " [-s [-c <chunk_size>]] <new_ESS_ids_file>" << std::endl;
+    throw std::runtime_error("wrong number of arguments");
+  }
+
+  int num_threads;
+  #pragma omp parallel shared(num_threads) default(none)
+  { num_threads = omp_get_num_threads(); };
 
-    const int OUT_SIZE_TH = -1;
-    std::string key = ExtractKeyFromType(kv.first);
+  std::cerr << "num_threads: " << num_threads << std::endl;
 
-    std::ofstream fout(std::string("ESS_") + key);
-    int count = 0;
-    for (const Entry& input: kv.second) {
-      fout << input.gid << ' ' << input.c_prob << ' ' << input.h.at(0) << ' ' << input.h.at(1) << ' ' << input.h.at(2) << std::endl;
-      count++;
-      if (count == OUT_SIZE_TH) break;
+  std::vector<stats_map_t> stats(num_threads);
+  ClassWriters writers;
+
+  if (presorted) {
+    // The entries are read in chunks, and each chunk is written to the files before the next one is read.
+    // Since the input is sorted, the files are sorted as well.
+    EntryReader reader(files[0]);
+    std::vector<Entry> chunk;
+    std::vector<std::string> types;
+    chunk.reserve(chunk_size);
+    Entry e;
+    bool has_prev = false;
+    uint64_t prev = 0, num_read = 0;
+    while (true) {
+      chunk.clear();
+      while (chunk.size() < chunk_size && reader.Next(e)) {
+        if (has_prev && e.gid <= prev) {
+          if (e.gid == prev) { continue; }
+          std::cerr << files[0] << " is not sorted at gid " << e.gid << std::endl;
+          throw std::runtime_error("input is not sorted");
+        }
+        chunk.push_back(e);
+        prev = e.gid;
+        has_prev = true;
+      }
+      if (chunk.empty()) { break; }
+      types.resize(chunk.size());
+      ClassifyEntries(chunk, stats, false, [&types](size_t i, int, const std::string& type) { types[i] = type; });
+      for (size_t i = 0; i < chunk.size(); i++) { writers.Write(types[i], chunk[i]); }
+      num_read += chunk.size();
+      std::cerr << "progress: " << num_read << " entries" << std::endl;
+    }
+  }
+  else {
+    std::vector<Entry> inputs = Entry::LoadAndUniqSort(files[0].c_str());
+    ClassifiedEntries classified(num_threads);
+    ClassifyEntries(inputs, stats, true, [&inputs,&classified](size_t i, int th, const std::string& type) { classified.Add(th, type, inputs[i]); });
+    std::vector<Entry>().swap(inputs);
+    for (const auto& kv: classified.Merge()) {
+      for (const Entry& input: kv.second) { writers.Write(kv.first, input); }
     }
-    fout.close();
   }
 
+  PrintStats(MergeStats(stats));
+
   return 0;
-}
\ No newline at end of file
+}
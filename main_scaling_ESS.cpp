@@ -0,0 +1,59 @@
+#include <iostream>
+#include <vector>
+#include <array>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <iomanip>
+#include <omp.h>
+#include <icecream.hpp>
+
+#include "Game.hpp"
+#include "ErrorRateContinuation.hpp"
+#include "Entry.hpp"
+
+
+int main(int argc, char* argv[]) {
+
+  if (argc < 2) {
+    std::cerr << "wrong number of arguments" << std::endl;
+    std::cerr << "  usage: " << argv[0] << " <ESS_ids_file> [mu ...]" << std::endl;
+    throw std::runtime_error("wrong number of arguments");
+  }
+
+  std::vector<Entry> inputs = Entry::LoadAndUniqSort(argv[1]);
+
+  std::vector<ErrorRateContinuation::mu_t> error_rates;
+  for (int i = 2; i < argc; i++) {
+    double mu = std::stod(argv[i]);
+    error_rates.push_back({mu, mu});
+  }
+  if (error_rates.empty()) {
+    error_rates = { {1.0e-2, 1.0e-2}, {1.0e-3, 1.0e-3}, {1.0e-4, 1.0e-4}, {1.0e-5, 1.0e-5} };
+  }
+  std::sort(error_rates.begin(), error_rates.end(), std::greater<ErrorRateContinuation::mu_t>());
+
+  std::vector<std::vector<ErrorRateContinuation::Point>> outs(inputs.size());
+  size_t n_not_continued = 0;
+
+  #pragma omp parallel for shared(inputs,outs,error_rates,std::cerr) reduction(+:n_not_continued) default(none) schedule(dynamic, 100)
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (inputs.size() > 20 && i % (inputs.size()/20) == 0) { std::cerr << "progress: " << (i*100)/inputs.size() << " %" << std::endl; }
+    outs[i] = ErrorRateContinuation(inputs[i].gid).Solve(error_rates);
+    for (size_t j = 1; j < outs[i].size(); j++) {
+      if (!outs[i][j].continued) { n_not_continued++; }
+    }
+  }
+  std::cerr << "number of points calculated without continuation: " << n_not_continued << std::endl;
+
+  // gid mu_e mu_a h_B h_N h_G c_prob
+  std::cout << std::setprecision(6);
+  for (size_t i = 0; i < inputs.size(); i++) {
+    for (const auto& p: outs[i]) {
+      std::cout << inputs[i].gid << ' ' << p.mu_e << ' ' << p.mu_a << ' '
+                << p.h_star[0] << ' ' << p.h_star[1] << ' ' << p.h_star[2] << ' ' << p.coop_prob << "\n";
+    }
+  }
+
+  return 0;
+}
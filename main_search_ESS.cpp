@@ -6,10 +6,14 @@
 #include <fstream>
 #include <cassert>
 #include <ctime>
+#include <memory>
+#include <map>
 #include "omp.h"
 #include "mpi.h"
 #include "Strategy.hpp"
 #include "Game.hpp"
+#include "NormalizedRDIndex.hpp"
+#include "RDIndexFile.hpp"
 #include <caravan.hpp>
 
 
@@ -48,38 +52,75 @@ std::vector<ActionRule> ActionRuleCandidates(const ReputationDynamics& rd) {
 
 class Output {
   public:
-  Output() : gid(0), cprob(0.0), h({0.0, 0.0, 0.0}) {};
-  Output(uint64_t _gid, double _cprob, const std::array<double,3>& _h) : gid(_gid), cprob(_cprob), h(_h) {};
-  explicit Output(const Game& g) : gid(g.ID()), cprob(g.ResidentCoopProb()), h(g.ResidentEqReputation()) {};
+  Output() : gid(0), cprob(0.0), h({0.0, 0.0, 0.0}), b_range({0.0, 0.0}) {};
+  Output(uint64_t _gid, double _cprob, const std::array<double,3>& _h) : gid(_gid), cprob(_cprob), h(_h), b_range({0.0, 0.0}) {};
+  explicit Output(const Game& g, const std::array<double,2>& _b_range = {0.0, 0.0}) : gid(g.ID()), cprob(g.ResidentCoopProb()), h(g.ResidentEqReputation()), b_range(_b_range) {};
   uint64_t gid;
   double cprob;
   std::array<double,3> h;
+  std::array<double,2> b_range;  // range of benefit where the norm is ESS. Calculated only in the benefit-range mode
   bool operator<(const Output& rhs) const { return gid < rhs.gid; }
+  // fixed-size binary record of gid, cprob, and h, followed by b_range when with_b_range is true. See Entry::LoadShards.
+  void WriteBinary(std::ostream& os, bool with_b_range) const {
+    os.write(reinterpret_cast<const char*>(&gid), sizeof(gid));
+    os.write(reinterpret_cast<const char*>(&cprob), sizeof(cprob));
+    os.write(reinterpret_cast<const char*>(h.data()), sizeof(double) * h.size());
+    if (with_b_range) { os.write(reinterpret_cast<const char*>(b_range.data()), sizeof(double) * b_range.size()); }
+  }
 
-  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Output, gid, cprob, h);
+  NLOHMANN_DEFINE_TYPE_INTRUSIVE(Output, gid, cprob, h, b_range);
 };
 
 struct Param {
   double mu_e, mu_a, benefit, coop_prob_th;
-  Param(double _mu_e, double _mu_a, double _benefit, double _coop_prob_th) :
-  mu_e(_mu_e), mu_a(_mu_a), benefit(_benefit), coop_prob_th(_coop_prob_th) {};
+  // When benefit_range is true, the range of benefit [b_lower, b_upper] where the norm is ESS is calculated instead of testing `benefit`.
+  // The norms are printed when the range overlaps with [benefit_upper_min, benefit_lower_max].
+  bool benefit_range = false;
+  double benefit_upper_min = 0.0, benefit_lower_max = 0.0;
+  Game::SolverOption solver_option;
+  bool early_abandon;  // stop the resident solve once its cooperation probability is estimated not to exceed coop_prob_th (heuristic; ignored with newton_resident)
+  bool binary_output = false;  // each process writes binary records to its own shard file instead of sending the results to the master
+  Param(double _mu_e, double _mu_a, double _benefit, double _coop_prob_th, const Game::SolverOption& _solver_option, bool _early_abandon) :
+  mu_e(_mu_e), mu_a(_mu_a), benefit(_benefit), coop_prob_th(_coop_prob_th), solver_option(_solver_option), early_abandon(_early_abandon) {};
 };
 
-std::pair<std::vector<Output>, uint64_t> find_ESSs(const ReputationDynamics& rd, const Param& prm) {
-  std::vector<Output> ess_ids;
+struct SearchCounts {
   uint64_t num_total = 0ull;
+  uint64_t num_rejected = 0ull;  // number of cooperative games which turned out not to be ESS
+  uint64_t num_mutant_evals_rejected = 0ull;  // number of mutants examined until the rejection of those games
+};
+
+std::pair<std::vector<Output>, SearchCounts> find_ESSs(const ReputationDynamics& rd, const Param& prm) {
+  std::vector<Output> ess_ids;
+  SearchCounts counts;
   std::vector<ActionRule> act_rules = ActionRuleCandidates(rd);
   for (const ActionRule& ar: act_rules) {
-    num_total++;
+    counts.num_total++;
     Game g(prm.mu_e, prm.mu_a, rd, ar);
-    if (g.ResidentCoopProb() > prm.coop_prob_th) {
+    const bool cooperative = prm.early_abandon ? g.CalcHStarResidentAbove(prm.coop_prob_th) : (g.ResidentCoopProb() > prm.coop_prob_th);
+    if (cooperative && prm.benefit_range) {
+      auto b_range = g.ESS_Benefit_Range(prm.benefit_lower_max, prm.benefit_upper_min);
+      if (b_range[0] <= b_range[1]) {
+        Game new_g = g.NormalizedGame();
+        ess_ids.emplace_back(new_g, b_range);
+      }
+      else {
+        counts.num_rejected++;
+        counts.num_mutant_evals_rejected += g.Stats().n_mutant_evals;
+      }
+    }
+    else if (cooperative) {
       if (g.IsESS(prm.benefit, 1.0)) {
         Game new_g = g.NormalizedGame();
         ess_ids.emplace_back(new_g);
       }
+      else {
+        counts.num_rejected++;
+        counts.num_mutant_evals_rejected += g.Stats().n_mutant_evals;
+      }
     }
   }
-  return std::make_pair(ess_ids, num_total);
+  return std::make_pair(ess_ids, counts);
 }
 
 std::vector<uint64_t> LoadInputFiles(const char* fname) {
@@ -100,7 +141,7 @@ std::vector<uint64_t> LoadInputFiles(const char* fname) {
   return std::move(rep_ids);
 }
 
-std::vector<Output> SearchRepDsOpenMP(const std::vector<uint64_t>& repd_ids, const Param& prm) {
+std::vector<Output> SearchRepDsOpenMP(const uint64_t* repd_ids, size_t num_repds, const Param& prm) {
   int num_threads;
   #pragma omp parallel shared(num_threads) default(none)
   { num_threads = omp_get_num_threads(); };
@@ -108,8 +149,8 @@ std::vector<Output> SearchRepDsOpenMP(const std::vector<uint64_t>& repd_ids, con
   std::vector<std::vector<Output>> outs_thread(num_threads);
   // std::vector<uint64_t> ESS_ids;
 
-  #pragma omp parallel for shared(outs_thread,repd_ids,prm,std::cerr) default(none) schedule(dynamic)
-  for (size_t i = 0; i <repd_ids.size(); i++) {
+  #pragma omp parallel for shared(outs_thread,repd_ids,num_repds,prm,std::cerr) default(none) schedule(dynamic)
+  for (size_t i = 0; i < num_repds; i++) {
     int th = omp_get_thread_num();
     ReputationDynamics rd(repd_ids[i]);
     auto t1 = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
@@ -119,7 +160,10 @@ std::vector<Output> SearchRepDsOpenMP(const std::vector<uint64_t>& repd_ids, con
     outs_thread[th].insert(outs_thread[th].end(), ans.first.begin(), ans.first.end());
 
     auto t2 = std::chrono::system_clock::to_time_t( std::chrono::system_clock::now() );
-    std::cerr << std::ctime(&t2) << ' ' << rd.ID() << " done" << std::endl;
+    const SearchCounts& c = ans.second;
+    std::cerr << std::ctime(&t2) << ' ' << rd.ID() << " done (rejected: " << c.num_rejected
+              << ", mutants/rejected: " << (c.num_rejected > 0 ? static_cast<double>(c.num_mutant_evals_rejected) / c.num_rejected : 0.0)
+              << ")" << std::endl;
   }
 
   std::vector<Output> outs;
@@ -131,6 +175,28 @@ std::vector<Output> SearchRepDsOpenMP(const std::vector<uint64_t>& repd_ids, con
 
 using json = nlohmann::json;
 
+std::string ShardPath(int rank) { return "ESS_ids." + std::to_string(rank) + ".bin"; }
+
+// The manifest lists the shards so that the set of shards can be read as a single dataset by Entry::Load
+void WriteManifest(const std::map<int,uint64_t>& shard_records, const Param& prm) {
+  json columns = {"gid", "cprob", "h_B", "h_N", "h_G"};
+  if (prm.benefit_range) { columns.emplace_back("b_lower"); columns.emplace_back("b_upper"); }
+  json shards = json::array();
+  uint64_t total = 0;
+  for (const auto& kv: shard_records) {
+    shards.push_back({ {"path", ShardPath(kv.first)}, {"num_records", kv.second} });
+    total += kv.second;
+  }
+  json manifest = {
+    {"format", "ESS_shards"}, {"version", 1},
+    {"columns", columns}, {"record_size", columns.size() * sizeof(double)},
+    {"mu_e", prm.mu_e}, {"mu_a", prm.mu_a}, {"benefit", prm.benefit},
+    {"num_records", total}, {"shards", shards}
+  };
+  std::ofstream fout("ESS_ids.manifest.json");
+  fout << manifest.dump(2) << std::endl;
+}
+
 Param BcastParameters(char* input_json_path) {
   std::vector<uint8_t> opt_buf;
   int rank = 0;
@@ -155,12 +221,42 @@ Param BcastParameters(char* input_json_path) {
     MPI_Bcast(opt_buf.data(), opt_buf.size(), MPI_BYTE, 0, MPI_COMM_WORLD);
   }
   json j = json::from_msgpack(opt_buf);
-  return Param(
+  Game::SolverOption opt;
+  opt.integrator = Game::ParseIntegrator(j.value("integrator", "RK4"));
+  opt.newton_resident = j.value("newton_resident", false);
+  opt.mutant_solver = Game::ParseMutantSolver(j.value("mutant_solver", "linear"));
+  opt.mutant_order = Game::ParseMutantOrder(j.value("mutant_order", "id"));
+  const bool benefit_range = (j.find("benefit_upper_min") != j.end() || j.find("benefit_lower_max") != j.end());
+  Param prm(
     j.at("mu_e").get<double>(),
     j.at("mu_a").get<double>(),
-    j.at("benefit").get<double>(),
-    j.at("coop_prob_th").get<double>()
+    benefit_range ? j.value("benefit", 0.0) : j.at("benefit").get<double>(),
+    j.at("coop_prob_th").get<double>(),
+    opt,
+    j.value("early_abandon", false)
     );
+  if (benefit_range) {
+    prm.benefit_range = true;
+    prm.benefit_upper_min = j.value("benefit_upper_min", 1.0);
+    prm.benefit_lower_max = j.value("benefit_lower_max", std::numeric_limits<double>::max());
+  }
+  prm.binary_output = (j.value("output", "text") == "binary");
+  return prm;
+}
+
+// Build NormalizedRDIndex of all the IDs. Each process counts the normalized IDs in its share of the blocks,
+// and the counts are gathered by all the processes, so that the enumeration is not repeated in every process.
+std::unique_ptr<NormalizedRDIndex> BuildNormalizedRDIndex(int my_rank, int num_procs) {
+  const uint64_t n_blocks = NormalizedRDIndex::NumBlocks;
+  std::vector<int> recv_counts(num_procs), displs(num_procs);
+  for (int r = 0; r < num_procs; r++) {
+    displs[r] = static_cast<int>(n_blocks * r / num_procs);
+    recv_counts[r] = static_cast<int>(n_blocks * (r + 1) / num_procs) - displs[r];
+  }
+  const std::vector<uint64_t> mine = NormalizedRDIndex::CountBlocks(displs[my_rank], displs[my_rank] + recv_counts[my_rank]);
+  std::vector<uint64_t> counts(n_blocks);
+  MPI_Allgatherv(mine.data(), recv_counts[my_rank], MPI_UINT64_T, counts.data(), recv_counts.data(), displs.data(), MPI_UINT64_T, MPI_COMM_WORLD);
+  return std::unique_ptr<NormalizedRDIndex>(new NormalizedRDIndex(NormalizedRDIndex::FromBlockCounts(0, counts)));
 }
 
 int main(int argc, char *argv[]) {
@@ -178,17 +274,41 @@ int main(int argc, char *argv[]) {
   if (argc != 4) {
     std::cerr << "invalid number of arguments" << std::endl;
     std::cerr << "  usage: " << argv[0] << " <reputation dynamics id list> <input_json> <chunk size>" << std::endl;
+    std::cerr << "    the id list is either a text file, an RD index file, or \"normalized\"" << std::endl;
     MPI_Abort(MPI_COMM_WORLD, 1);
   }
 
+  // When the IDs are given by an RD index file or by NormalizedRDIndex, a task is a range [offset, offset+count) of the IDs.
+  // Every process maps the file (or shares the index) so that the master does not need to load and send the IDs.
+  std::unique_ptr<RDIndexFile> rd_file;
+  std::unique_ptr<NormalizedRDIndex> rd_index;
+  if (std::string(argv[1]) == "normalized") {
+    rd_index = BuildNormalizedRDIndex(my_rank, num_procs);
+  }
+  else if (RDIndexFile::IsRDIndexFile(argv[1])) {
+    rd_file.reset(new RDIndexFile(argv[1]));
+  }
+  const bool range_task = (rd_file || rd_index);
+
   Param prm = BcastParameters(argv[2]);
+  Game::DefaultSolverOption() = prm.solver_option;
   const size_t chunk_size = std::stoul(argv[3]);
 
   std::ofstream fout;
+  // In the binary output mode, the results are written to the shard of each process and the master receives only the number of records.
+  std::ofstream shard_out;
+  std::map<int, uint64_t> shard_records;
 
-  std::function<void(caravan::Queue&)> on_init = [&argv,chunk_size,&fout](caravan::Queue& q) {
+  std::function<void(caravan::Queue&)> on_init = [&argv,chunk_size,&fout,&prm,&rd_file,&rd_index,range_task](caravan::Queue& q) {
+    if (!prm.binary_output) { fout.open("ESS_ids"); }
+    if (range_task) {
+      const uint64_t num = rd_file ? rd_file->Size() : rd_index->Size();
+      for (uint64_t offset = 0; offset < num; offset += chunk_size) {
+        q.Push(json::array({offset, std::min<uint64_t>(chunk_size, num - offset)}));
+      }
+      return;
+    }
     const std::vector<uint64_t> repd_ids = LoadInputFiles(argv[1]);
-    fout.open("ESS_ids");
 
     json buf;
     for(uint64_t id : repd_ids) {
@@ -202,24 +322,58 @@ int main(int argc, char *argv[]) {
       q.Push(buf);
     }
   };
-  std::function<void(int64_t, const json&, const json&, caravan::Queue&)> on_result_receive = [&fout](int64_t task_id, const json& input, const json& output, caravan::Queue& q) {
+  std::function<void(int64_t, const json&, const json&, caravan::Queue&)> on_result_receive = [&fout,&prm,&shard_records](int64_t task_id, const json& input, const json& output, caravan::Queue& q) {
+    if (prm.binary_output) {
+      shard_records[output.at("rank").get<int>()] += output.at("num_records").get<uint64_t>();
+      size_t s = q.Size();
+      if (s % 100 == 0) { std::cerr << "q.Size: " << s << std::endl; }
+      return;
+    }
     for (auto j: output) {
       const Output o = j.get<Output>();
-      fout << o.gid << ' ' << o.cprob << ' ' << o.h[0] << ' ' << o.h[1] << ' ' << o.h[2] << "\n";
+      fout << o.gid << ' ' << o.cprob << ' ' << o.h[0] << ' ' << o.h[1] << ' ' << o.h[2];
+      if (prm.benefit_range) { fout << ' ' << o.b_range[0] << ' ' << o.b_range[1]; }
+      fout << "\n";
     }
     size_t s = q.Size();
     if (s % 100 == 0) { std::cerr << "q.Size: " << s << std::endl; }
   };
-  std::function<json(const json&)> do_task = [prm](const json& input) {
+  std::function<json(const json&)> do_task = [&prm,&rd_file,&rd_index,range_task,&shard_out,my_rank](const json& input) {
     std::vector<uint64_t> repd_ids;
-    for (const auto in: input) {
-      repd_ids.emplace_back( in.get<uint64_t>() );
+    std::vector<Output> outs;
+    if (range_task) {
+      const uint64_t offset = input.at(0).get<uint64_t>(), count = input.at(1).get<uint64_t>();
+      if (rd_file) {
+        // read the slice directly from the mapped pages
+        outs = SearchRepDsOpenMP(rd_file->Data() + offset, count, prm);
+      }
+      else {
+        repd_ids = rd_index->Slice(offset, count);
+      }
+    }
+    else {
+      for (const auto in: input) {
+        repd_ids.emplace_back( in.get<uint64_t>() );
+      }
+    }
+    if (!repd_ids.empty()) { outs = SearchRepDsOpenMP(repd_ids.data(), repd_ids.size(), prm); }
+    if (!prm.binary_output) { return json(outs); }
+
+    if (!shard_out.is_open()) {
+      shard_out.open(ShardPath(my_rank), std::ios::binary);
+      if (!shard_out) {
+        std::cerr << "Failed to open file " << ShardPath(my_rank) << std::endl;
+        MPI_Abort(MPI_COMM_WORLD, 2);
+      }
     }
-    std::vector<Output> outs = SearchRepDsOpenMP(repd_ids, prm);
-    return json(outs);
+    for (const Output& o: outs) { o.WriteBinary(shard_out, prm.benefit_range); }
+    shard_out.flush();  // the records are complete when the master receives their number
+    return json{ {"rank", my_rank}, {"num_records", outs.size()} };
   };
 
   caravan::Start(on_init, on_result_receive, do_task, MPI_COMM_WORLD);
+  shard_out.close();
+  if (my_rank == 0 && prm.binary_output) { WriteManifest(shard_records, prm); }
 
   MPI_Finalize();
 
@@ -1,25 +1,56 @@
 #include <iostream>
 #include <fstream>
+#include <string>
 #include "Strategy.hpp"
+#include "NormalizedRDIndex.hpp"
+#include "RDIndexFile.hpp"
 
 
 int main( int argc, char* argv[]) {
 
-  uint64_t max = 387'420'489ull;  // 3**18
+  // with "-b <file>", the IDs are written to the file in the binary format of RDIndexFile instead of printing them
+  std::string binary_path;
+  if (argc >= 3 && std::string(argv[1]) == "-b") {
+    binary_path = argv[2];
+    argc -= 2;
+    argv += 2;
+  }
+  if (argc != 1 && argc != 3) {
+    std::cerr << "Usage: " << argv[0] << " [-b RD_index_file] [offset count]" << std::endl;
+    return 1;
+  }
 
-  std::vector<uint64_t> ans;
-  for (uint64_t i = 0; i < max; i++) {
-    if (i % 1'000'000 == 0) { std::cerr << i << std::endl; }
-    ReputationDynamics rd(i);
-    if (rd.Normalized().first.ID() == i) {
-      ans.push_back(i);
+  NormalizedRDIndex index;
+  std::cerr << index.Size() << std::endl;
+
+  uint64_t begin = 0, end = index.Size();
+  if (argc == 3) {
+    begin = std::min<uint64_t>(std::stoull(argv[1]), index.Size());
+    end = begin + std::min<uint64_t>(std::stoull(argv[2]), index.Size() - begin);
+  }
+
+  std::ofstream fout;
+  if (!binary_path.empty()) {
+    fout.open(binary_path, std::ios::binary);
+    if (!fout) {
+      std::cerr << "Failed to open file " << binary_path << std::endl;
+      return 1;
     }
+    RDIndexFile::WriteHeader(fout, end - begin);
   }
 
-  for (uint64_t a : ans) {
-    std::cout << a << "\n";
+  const uint64_t chunk = 1'000'000ull;
+  for (uint64_t offset = begin; offset < end; offset += chunk) {
+    std::cerr << offset << std::endl;
+    const std::vector<uint64_t> ids = index.Slice(offset, std::min(chunk, end - offset));
+    if (fout.is_open()) {
+      RDIndexFile::WriteIDs(fout, ids);
+      continue;
+    }
+    for (uint64_t a : ids) {
+      std::cout << a << "\n";
+    }
   }
-  std::cerr << ans.size() << std::endl;
 
   return 0;
-}
\ No newline at end of file
+}
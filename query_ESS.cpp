@@ -0,0 +1,69 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <icecream.hpp>
+#include "Entry.hpp"
+#include "GidSet.hpp"
+
+
+// A set is given either as a GidSet file or as an ESS_ids file in any format, which is converted on the fly.
+GidSet LoadSet(const std::string& path) {
+  if (GidSet::IsGidSetFile(path.c_str())) { return GidSet::Load(path); }
+  std::vector<Entry> entries = Entry::LoadAndUniqSort(path.c_str());
+  GidSet s;
+  for (const Entry& e: entries) { s.Add(e.gid); }
+  return s;
+}
+
+int main(int argc, char* argv[]) {
+  const std::string cmd = (argc >= 2) ? argv[1] : "";
+  if ( !(cmd == "build" && argc == 4) && !(cmd == "info" && argc >= 3) && !(cmd == "print" && argc == 3)
+       && !((cmd == "contains" || cmd == "rank") && argc >= 4)
+       && !((cmd == "union" || cmd == "intersection" || cmd == "difference") && argc >= 5) ) {
+    std::cerr << "wrong number of arguments" << std::endl;
+    std::cerr << "  usage: " << argv[0] << " build <ESS_ids_file> <gid_set_file>" << std::endl;
+    std::cerr << "         " << argv[0] << " info <set> ..." << std::endl;
+    std::cerr << "         " << argv[0] << " print <set>" << std::endl;
+    std::cerr << "         " << argv[0] << " contains <gid> <set> ..." << std::endl;
+    std::cerr << "         " << argv[0] << " rank <gid> <set> ..." << std::endl;
+    std::cerr << "         " << argv[0] << " union|intersection|difference <gid_set_file> <set1> <set2> ..." << std::endl;
+    std::cerr << "  <set> is either a gid set file or an ESS_ids file" << std::endl;
+    throw std::runtime_error("wrong number of arguments");
+  }
+
+  if (cmd == "build") {
+    GidSet s = LoadSet(argv[2]);
+    s.Save(argv[3]);
+    std::cerr << s.Size() << " gids, " << s.NumBytes() << " bytes" << std::endl;
+  }
+  else if (cmd == "info") {
+    for (int i = 2; i < argc; i++) {
+      GidSet s = LoadSet(argv[i]);
+      std::cout << argv[i] << ": " << s.Size() << " gids, " << s.NumBytes() << " bytes" << std::endl;
+    }
+  }
+  else if (cmd == "print") {
+    LoadSet(argv[2]).ForEach([](uint64_t gid) { std::cout << gid << "\n"; });
+  }
+  else if (cmd == "contains" || cmd == "rank") {
+    const uint64_t gid = std::stoull(argv[2]);
+    for (int i = 3; i < argc; i++) {
+      GidSet s = LoadSet(argv[i]);
+      std::cout << argv[i] << ": " << ((cmd == "contains") ? s.Contains(gid) : s.Rank(gid)) << std::endl;
+    }
+  }
+  else {
+    // the difference is the gids in set1 but not in any of the others
+    GidSet s = LoadSet(argv[3]);
+    for (int i = 4; i < argc; i++) {
+      GidSet t = LoadSet(argv[i]);
+      if (cmd == "union") { s = GidSet::Union(s, t); }
+      else if (cmd == "intersection") { s = GidSet::Intersection(s, t); }
+      else { s = GidSet::Difference(s, t); }
+    }
+    s.Save(argv[2]);
+    std::cerr << s.Size() << " gids, " << s.NumBytes() << " bytes" << std::endl;
+  }
+
+  return 0;
+}
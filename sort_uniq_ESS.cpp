@@ -3,21 +3,40 @@
 #include <vector>
 #include <array>
 #include <tuple>
+#include <string>
 #include <icecream.hpp>
 #include "Entry.hpp"
+#include "ExternalSort.hpp"
 
 
 int main(int argc, char* argv[]) {
-  if (argc != 2) {
+  // with "-m <MB>", the files are sorted by an external merge sort using at most the given memory. The runs are written in "-T <dir>".
+  size_t memory_mb = 0;
+  std::string tmp_dir = ".";
+  std::vector<std::string> inputs;
+  for (int i = 1; i < argc; i++) {
+    const std::string arg(argv[i]);
+    if (arg == "-m" && i + 1 < argc) { memory_mb = std::stoul(argv[++i]); }
+    else if (arg == "-T" && i + 1 < argc) { tmp_dir = argv[++i]; }
+    else { inputs.push_back(arg); }
+  }
+  if (inputs.empty() || (inputs.size() > 1 && memory_mb == 0)) {
     std::cerr << "wrong number of arguments" << std::endl;
     std::cerr << "  usage: " << argv[0] << " <ESS_ids_file>" << std::endl;
+    std::cerr << "         " << argv[0] << " -m <memory_MB> [-T <tmp_dir>] <ESS_ids_file> ..." << std::endl;
     throw std::runtime_error("wrong number of arguments");
   }
 
-  std::vector<Entry> inputs = Entry::LoadAndUniqSort(argv[1]);
-  for(const auto& in: inputs) {
+  if (memory_mb > 0) {
+    ExternalSortUniq sorter(memory_mb << 20, tmp_dir);
+    sorter.Run(inputs, [](const Entry& e) { std::cout << e << "\n"; });
+    return 0;
+  }
+
+  std::vector<Entry> entries = Entry::LoadAndUniqSort(inputs[0].c_str());
+  for(const auto& in: entries) {
     std::cout << in << "\n";
   }
 
   return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,71 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <random>
+#include "Entry.hpp"
+
+// parse a line of the text format of ESS_ids
+int Parse(const std::string& line, Entry& e) {
+  return Entry::ParseLine(line.data(), line.data() + line.size(), e);
+}
+
+// parse a token as c_prob and compare the bits with strtod
+bool SameAsStrtod(const std::string& token) {
+  Entry e;
+  if (Parse("1 " + token + " 0 0 0", e) != 1) { return false; }
+  const double expected = std::strtod(token.c_str(), nullptr);
+  if (std::isnan(expected)) { return std::isnan(e.c_prob); }
+  return std::memcmp(&e.c_prob, &expected, sizeof(double)) == 0;
+}
+
+int main(int argc, char *argv[]) {
+
+  { // testing the fast path of the decimals against strtod
+    std::mt19937_64 rng(1234);
+    char buf[64];
+    for (int n = 0; n < 200000; n++) {
+      const int digits = 1 + rng() % 15;
+      const double x = std::ldexp(static_cast<double>(rng() >> 11), -53) * std::pow(10.0, static_cast<int>(rng() % 41) - 20);
+      if (n % 2 == 0) { std::snprintf(buf, sizeof(buf), "%.*e", digits - 1, x); }
+      else { std::snprintf(buf, sizeof(buf), "%.*f", static_cast<int>(rng() % 18), x); }
+      assert( SameAsStrtod(buf) );
+      assert( SameAsStrtod(std::string("-") + buf) );
+    }
+    for (const std::string t: {"0", "0.0", "-0", "1", "0.5", ".5", "5.", "1e22", "1e-22", "0.001", "+2.5E+3", "123456789012345"}) {
+      assert( SameAsStrtod(t) );
+    }
+  }
+
+  { // testing the tokens falling back to strtod
+    for (const std::string t: {"1e400", "-1e400", "1e-400", "4.9e-324", "nan", "NAN", "inf", "-infinity", "0x1.8p1", "0X10",
+                               "12345678901234567890", "1234567890.1234567890", "0.12345678901234567890123", "1.7976931348623157e308"}) {
+      assert( SameAsStrtod(t) );
+    }
+    Entry e;
+    assert( Parse("1 1e400 0 0 0", e) == 1 && std::isinf(e.c_prob) );
+    assert( Parse("1 nan 0 0 0", e) == 1 && std::isnan(e.c_prob) );
+    assert( Parse("1 0x1.8p1 0 0 0", e) == 1 && e.c_prob == 3.0 );
+  }
+
+  { // testing the lines
+    Entry e;
+    assert( Parse("137863130404 0.99 0.001 0.002 0.997", e) == 1 );
+    assert( e.gid == 137863130404ull && e.c_prob == 0.99 && e.h[0] == 0.001 && e.h[1] == 0.002 && e.h[2] == 0.997 );
+    assert( Parse("  7\t1 0 0 1 2.0 3.0\r", e) == 1 && e.gid == 7 && e.h[2] == 1.0 );  // the extra columns are skipped
+    assert( Parse("18446744073709551615 1 0 0 1", e) == 1 && e.gid == 18446744073709551615ull );
+    assert( Parse("", e) == 0 && Parse(" \t\r", e) == 0 );
+
+    // malformed lines
+    for (const std::string line: {"18446744073709551616 1 0 0 1", "99999999999999999999999 1 0 0 1", "-1 1 0 0 1", "1.5 1 0 0 1", "12x 1 0 0 1",
+                                  "1 1e 0 0 1", "1 1.2.3 0 0 1", "1 1e+ 0 0 1", "1 . 0 0 1", "1 - 0 0 1", "1 abc 0 0 1", "1 0.5x 0 0 1",
+                                  "1 1 0 0", "1"}) {
+      assert( Parse(line, e) == -1 );
+    }
+  }
+
+  return 0;
+}
@@ -5,6 +5,7 @@
 #include <icecream.hpp>
 #include "Game.hpp"
 #include "PopulationFlow.hpp"
+#include "ErrorRateContinuation.hpp"
 
 
 bool Close(double d1, double d2, double tolerance = 1.0e-2) {
@@ -232,5 +233,184 @@ int main(int argc, char *argv[]) {
     assert( rep_act2.second[2] == Action::C );
   }
 
+  {
+    // adaptive integrator reproduces the fixed-step RK4 results with fewer steps
+    Game g1(1.0e-3, 1.0e-3, 82377856438);
+    g1.option.integrator = Game::Integrator::RK4;
+    g1.option.mutant_solver = Game::MutantSolver::TimeIntegration;
+    Game g2(1.0e-3, 1.0e-3, 82377856438);
+    g2.option.integrator = Game::Integrator::DOPRI5;
+    g2.option.mutant_solver = Game::MutantSolver::TimeIntegration;
+    auto h1 = g1.ResidentEqReputation(), h2 = g2.ResidentEqReputation();
+    for (int i = 0; i < 3; i++) { assert( Close(h1[i], h2[i], 1.0e-5) ); }
+    assert( Close(g1.ResidentCoopProb(), g2.ResidentCoopProb(), 1.0e-5) );
+    assert( g2.Stats().n_solves == 1 );
+    assert( g2.Stats().n_flux_evals < g1.Stats().n_flux_evals );
+
+    ActionRule mut(439);
+    auto m1 = g1.HStarMutant(mut), m2 = g2.HStarMutant(mut);
+    for (int i = 0; i < 3; i++) { assert( Close(m1[i], m2[i], 1.0e-5) ); }
+    assert( g2.Stats().n_solves == 2 );
+    assert( g1.IsESS(2.0, 1.0) == g2.IsESS(2.0, 1.0) );
+  }
+
+  {
+    // Newton's method converges to the same attractor as the time integration
+    for (uint64_t id: {166243799309ull, 137863130404ull, 82377856438ull}) {
+      Game g1(1.0e-3, 1.0e-3, id);
+      Game g2(1.0e-3, 1.0e-3, id);
+      g2.option.newton_resident = true;
+      auto h1 = g1.ResidentEqReputation(), h2 = g2.ResidentEqReputation();
+      for (int i = 0; i < 3; i++) { assert( Close(h1[i], h2[i], 1.0e-4) ); }
+      assert( g2.Stats().n_newton_fallbacks == 0 );
+      assert( g2.Stats().n_flux_evals < g1.Stats().n_flux_evals );
+    }
+  }
+
+  {
+    // equilibrium of mutants by the linear solver
+    Game g(1.0e-3, 1.0e-3, 137863130404);
+    g.option.mutant_solver = Game::MutantSolver::Verify;
+    g.ResidentEqReputation();
+    for (uint64_t mut_id: {0ull, 308ull, 438ull, 511ull}) {
+      g.HStarMutant(ActionRule(mut_id));  // throws if the linear solver and the time integration disagree
+    }
+    assert( g.Stats().n_linear_solves == 4 );
+
+    Game g1(1.0e-3, 1.0e-3, 82377856438);
+    g1.ResidentEqReputation();
+    Game g2(1.0e-3, 1.0e-3, 82377856438);
+    g2.option.mutant_solver = Game::MutantSolver::TimeIntegration;
+    g2.ResidentEqReputation();
+    auto p1 = g1.FindNegativePayoffDiff(2.0, 1.0), p2 = g2.FindNegativePayoffDiff(2.0, 1.0);
+    assert( p1.first > 0.0 && p2.first > 0.0 );
+    assert( Close(p1.first, p2.first, 1.0e-6) );
+    assert( p1.second == p2.second );
+  }
+
+  {
+    // without assessment errors, a mutant may have several stationary distributions. The linear solver leaves it to the time integration.
+    Game g1(1.0e-3, 0.0, 137372968271);
+    g1.ResidentEqReputation();
+    Game g2(1.0e-3, 0.0, 137372968271);
+    g2.option.mutant_solver = Game::MutantSolver::TimeIntegration;
+    g2.ResidentEqReputation();
+    auto h1 = g1.HStarMutant(ActionRule(0)), h2 = g2.HStarMutant(ActionRule(0));
+    for (int i = 0; i < 3; i++) { assert( h1[i] == h2[i] ); }
+    assert( Close(h1[1], 1.0/3.0, 1.0e-4) );  // h_N stays at the initial value
+    assert( g1.Stats().n_linear_fallbacks == 1 && g1.Stats().n_linear_solves == 0 );
+    assert( g1.IsESS(2.0, 1.0) == g2.IsESS(2.0, 1.0) );
+  }
+
+  {
+    // the equilibrium is calculated once for each class of mutants having the identical dynamics
+    Game g(1.0e-3, 1.0e-3, 137863130404);
+    g.ResidentEqReputation();
+    assert( g.FreeSlotMask() == 0b000011011 );
+    assert( g.MutantClassRepresentative(ActionRule(308)).ID() == 292 );
+    assert( g.IsESS(1.2, 1.0) );
+    assert( g.Stats().n_linear_solves == 32 );  // 2^5 classes
+    auto range = g.ESS_Benefit_Range();
+
+    // same results as calculating all the mutants
+    double b_lower = std::numeric_limits<double>::min(), b_upper = std::numeric_limits<double>::max();
+    auto p_res = g.MutantCoopProbs(g.strategy.ar);
+    for (uint64_t i = 0; i < 512; i++) {
+      if (i == g.strategy.ar.ID()) continue;
+      auto p = g.MutantCoopProbs(ActionRule(i));
+      double rr = p_res.first, rr_recv = p_res.second, mr = p.first, rm = p.second;
+      if (rr_recv > rm) { b_lower = std::max(b_lower, (rr - mr) / (rr_recv - rm)); }
+      else if (rr_recv < rm) { b_upper = std::min(b_upper, (rr - mr) / (rr_recv - rm)); }
+      else if (mr <= rr) { b_lower = std::numeric_limits<double>::max(); b_upper = std::numeric_limits<double>::min(); }
+      if (b_lower > b_upper) {
+        b_lower = std::numeric_limits<double>::max(); b_upper = std::numeric_limits<double>::min();
+        break;
+      }
+    }
+    assert( range[0] == b_lower && range[1] == b_upper );
+
+    // the range is consistent with IsESS, and it is pruned outside of the requested window
+    assert( range[0] < 1.01 && range[1] > 10.0 );
+    for (double b: {1.01, 1.2, 2.0, 10.0}) { assert( g.IsESS(b, 1.0) ); }
+    assert( g.ESS_Benefit_Range(2.0, 1.5) == range );
+    auto pruned = g.ESS_Benefit_Range(1.0001, 0.5);
+    assert( pruned[0] > pruned[1] );
+  }
+
+  {
+    // ordering of the mutants changes the number of examined mutants, not the results
+    const uint64_t rd_id = 137863130404ull >> 9;
+    Game g1(1.0e-3, 1.0e-3, (rd_id << 9) + 260);
+    Game g2(1.0e-3, 1.0e-3, (rd_id << 9) + 260);
+    g2.option.mutant_order = Game::MutantOrder::Neighbors;
+    g1.ResidentEqReputation();
+    g2.ResidentEqReputation();
+    assert( !g1.IsESS(1.2, 1.0) && !g2.IsESS(1.2, 1.0) );
+    assert( g1.Stats().n_mutant_evals == 292 );
+    assert( g2.Stats().n_mutant_evals == 6 );
+
+    Game g3(1.0e-3, 1.0e-3, 137863130404);
+    Game g4(1.0e-3, 1.0e-3, 137863130404);
+    g4.option.mutant_order = Game::MutantOrder::Learned;
+    g3.ResidentEqReputation();
+    g4.ResidentEqReputation();
+    auto p3 = g3.FindNegativePayoffDiff(1.2, 1.0), p4 = g4.FindNegativePayoffDiff(1.2, 1.0);
+    assert( p3.first == p4.first && p3.second == p4.second );
+    assert( g4.Stats().n_mutant_evals == 511 );
+    auto order = g4.MutantOrderList();
+    assert( order.size() == 511 && order[0] == (292 ^ 1) );
+
+    uint64_t n = Game::Invasions().Count(261);
+    Game::Invasions().Record(261);
+    assert( Game::Invasions().Count(261) == n + 1 );
+  }
+
+  {
+    // the resident solve is abandoned when the cooperation probability is estimated not to exceed the threshold
+    Game g1(1.0e-3, 1.0e-3, 137863130404);
+    assert( g1.CalcHStarResidentAbove(0.99) );
+    assert( g1.Stats().n_early_abandons == 0 );
+    Game g2(1.0e-3, 1.0e-3, 137863130404);
+    auto h1 = g1.ResidentEqReputation(), h2 = g2.ResidentEqReputation();
+    for (int i = 0; i < 3; i++) { assert( h1[i] == h2[i] ); }  // RK4 steps are the same as the full solve
+
+    const uint64_t rd_id = 137863130404ull >> 9;
+    Game g3(1.0e-3, 1.0e-3, (rd_id << 9) + 1);  // cooperation probability 0.956
+    assert( !g3.CalcHStarResidentAbove(0.99) );
+    assert( g3.Stats().n_early_abandons == 1 );
+    Game g4(1.0e-3, 1.0e-3, (rd_id << 9) + 1);
+    assert( g4.ResidentCoopProb() < 0.99 );
+    assert( g3.Stats().n_flux_evals < g4.Stats().n_flux_evals );
+
+    // the decay of this trajectory slows down before converging to h* with the cooperation probability 0.993
+    Game g5(1.0e-4, 1.0e-4, 166439528830);
+    g5.option.integrator = Game::Integrator::DOPRI5;
+    assert( g5.CalcHStarResidentAbove(0.99) );
+  }
+
+  {
+    // equilibria along the error rates are continued by Newton's method
+    const uint64_t id = 137863130404ull;
+    auto eq = ErrorRateContinuation(id).Solve({ {1.0e-2, 1.0e-2}, {1.0e-3, 1.0e-3}, {1.0e-4, 1.0e-4}, {1.0e-5, 1.0e-5} });
+    assert( eq.size() == 4 );
+    assert( !eq[0].continued && eq[1].continued && eq[2].continued && eq[3].continued );
+    for (const auto& p: eq) {
+      Game g(p.mu_e, p.mu_a, id);
+      g.option.newton_resident = true;
+      auto h = g.ResidentEqReputation();
+      for (int i = 0; i < 3; i++) { assert( Close(h[i], p.h_star[i], 1.0e-8 * h[i]) ); }
+      assert( Close(g.ResidentCoopProb(), p.coop_prob, 1.0e-8) );
+    }
+    assert( Close(eq[3].h_star[0], 1.5e-5, 1.0e-8) && Close(eq[3].h_star[1], 5.0e-6, 1.0e-8) );
+
+    // the local scaling agrees with the finite difference, and h_B and h_N are O(mu)
+    const ErrorRateContinuation c(id);
+    auto s = c.LocalScaling(eq[1]);
+    auto q = c.SolveFrom(eq[1], {1.001e-3, 1.001e-3});
+    for (int i = 0; i < 3; i++) { assert( Close(s.exponent[i], std::log(q.h_star[i] / eq[1].h_star[i]) / std::log(1.001), 1.0e-3) ); }
+    assert( Close(s.exponent[3], std::log((1.0 - q.coop_prob) / (1.0 - eq[1].coop_prob)) / std::log(1.001), 1.0e-3) );
+    assert( Close(s.exponent[0], 1.0) && Close(s.exponent[1], 1.0) && std::abs(s.curvature[0]) < 1.0e-2 );
+  }
+
   return 0;
 }
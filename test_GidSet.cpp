@@ -0,0 +1,149 @@
+#include <iostream>
+#include <fstream>
+#include <cassert>
+#include <cstdio>
+#include <cstring>
+#include <set>
+#include <vector>
+#include <string>
+#include <random>
+#include <iterator>
+#include <algorithm>
+#include "GidSet.hpp"
+
+// random set mixing the sparse and the dense blocks of GameIDs
+std::set<uint64_t> RandomGids(std::mt19937_64& rng) {
+  std::set<uint64_t> s;
+  for (int k = 0; k < 300; k++) {
+    const uint64_t rd = rng() % 2000;
+    const int n = (rng() % 3 == 0) ? 200 + rng() % 312 : 1 + rng() % 40;
+    for (int j = 0; j < n; j++) { s.insert((rd << 9) | (rng() % 512)); }
+  }
+  return s;
+}
+
+std::vector<uint64_t> ToVector(const std::set<uint64_t>& s) { return std::vector<uint64_t>(s.begin(), s.end()); }
+
+std::string ReadFile(const std::string& path) {
+  std::ifstream fin(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+}
+
+void WriteFile(const std::string& path, const std::string& content) {
+  std::ofstream(path, std::ios::binary).write(content.data(), content.size());
+}
+
+bool Throws(const std::string& path) {
+  try { GidSet::Load(path); }
+  catch (const std::runtime_error&) { return true; }
+  return false;
+}
+
+int main(int argc, char *argv[]) {
+
+  const std::string path = "test_GidSet.gidset";
+
+  { // testing the set against std::set
+    std::mt19937_64 rng(1234);
+    for (int trial = 0; trial < 10; trial++) {
+      const std::set<uint64_t> A = RandomGids(rng), B = RandomGids(rng);
+      const GidSet a = GidSet::FromSorted(A.begin(), A.end()), b = GidSet::FromSorted(B.begin(), B.end());
+      assert( a.Size() == A.size() );
+      assert( a.ToVector() == ToVector(A) );
+
+      a.Save(path);
+      const GidSet l = GidSet::Load(path);  // the mapped set must behave in the same way
+      assert( l.Size() == a.Size() && l.NumBytes() == a.NumBytes() );
+      assert( l.ToVector() == ToVector(A) );
+      for (int q = 0; q < 20000; q++) {
+        const uint64_t g = ((rng() % 2100) << 9) | (rng() % 512);
+        const uint64_t rank = std::distance(A.begin(), A.lower_bound(g));
+        assert( a.Contains(g) == (A.count(g) > 0) && l.Contains(g) == (A.count(g) > 0) );
+        assert( a.Rank(g) == rank && l.Rank(g) == rank );
+      }
+      assert( l.Rank(1ull << 40) == A.size() );
+
+      std::vector<uint64_t> u, in, d;
+      std::set_union(A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(u));
+      std::set_intersection(A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(in));
+      std::set_difference(A.begin(), A.end(), B.begin(), B.end(), std::back_inserter(d));
+      assert( GidSet::Union(a, b).ToVector() == u && GidSet::Union(l, b).ToVector() == u );
+      assert( GidSet::Intersection(a, b).ToVector() == in && GidSet::Intersection(b, l).ToVector() == in );
+      assert( GidSet::Difference(a, b).ToVector() == d && GidSet::Difference(l, b).ToVector() == d );
+      assert( GidSet::Union(a, b).Size() == u.size() );
+    }
+  }
+
+  { // testing the additions
+    GidSet s;
+    s.Add(5);
+    s.Add(5);  // duplicates are ignored
+    s.Add(6);
+    assert( s.Size() == 2 );
+    bool thrown = false;
+    try { s.Add(4); } catch (const std::runtime_error&) { thrown = true; }
+    assert( thrown );
+
+    // a loaded set is read-only, while the sets made from it are not
+    s.Save(path);
+    GidSet l = GidSet::Load(path);
+    thrown = false;
+    try { l.Add(7); } catch (const std::runtime_error&) { thrown = true; }
+    assert( thrown );
+    GidSet u = GidSet::Union(l, GidSet());
+    u.Add(7);
+    assert( u.ToVector() == std::vector<uint64_t>({5, 6, 7}) );
+  }
+
+  { // testing the empty set and the broken files
+    GidSet().Save(path);
+    const GidSet e = GidSet::Load(path);
+    assert( e.Size() == 0 && !e.Contains(0) && e.Rank(100) == 0 );
+
+    const std::vector<uint64_t> v = {1, 2, 300};
+    GidSet::FromSorted(v.begin(), v.end()).Save(path);
+    const std::string content = ReadFile(path);
+    WriteFile(path, content.substr(0, content.size() - 1));
+    assert( Throws(path) );
+    std::ofstream(path, std::ios::binary).write("GIDSET0", 7);
+    assert( Throws(path) );
+    std::ofstream(path, std::ios::binary) << "1 0.9 0 0 1\n";
+    assert( Throws(path) && !GidSet::IsGidSetFile(path.c_str()) );
+  }
+
+  { // testing the corrupt tables and varints, which must not be read beyond the mapping
+    std::vector<uint64_t> v;
+    for (uint64_t i = 0; i < 300; i++) { v.push_back(i * 1000); }  // three blocks of 2-byte varints
+    GidSet::FromSorted(v.begin(), v.end()).Save(path);
+    const std::string content = ReadFile(path);
+    const size_t first = 24, pos = first + 3 * sizeof(uint64_t), bytes = pos + 3 * sizeof(uint64_t);
+    auto with_word = [&content](size_t offset, uint64_t w) {
+      std::string c = content;
+      std::memcpy(&c[offset], &w, sizeof(w));
+      return c;
+    };
+    assert( GidSet::Load(path).ToVector() == v );
+
+    WriteFile(path, with_word(pos + 8, content.size()));  // beyond the varints
+    assert( Throws(path) );
+    WriteFile(path, with_word(pos + 16, 1));  // not monotone
+    assert( Throws(path) );
+    WriteFile(path, with_word(first + 8, 0));  // the first GameIDs are not ascending
+    assert( Throws(path) );
+
+    std::string c = content;
+    c[bytes + 253] = static_cast<char>(c[bytes + 253] | 128);  // the last varint of the first block continues into the next block
+    WriteFile(path, c);
+    const GidSet l = GidSet::Load(path);  // only the tables and the last block are read by Load
+    bool thrown = false;
+    try { l.ToVector(); } catch (const std::runtime_error&) { thrown = true; }
+    assert( thrown );
+    c = content;
+    c.back() = static_cast<char>(c.back() | 128);  // the last varint runs over the end of the file
+    WriteFile(path, c);
+    assert( Throws(path) );
+  }
+
+  std::remove(path.c_str());
+  return 0;
+}
@@ -2,6 +2,8 @@
 #include <cassert>
 #include <set>
 #include "Strategy.hpp"
+#include "NormalizedRDIndex.hpp"
+#include "PrescriptionPattern.hpp"
 
 int main(int argc, char *argv[]) {
 
@@ -103,6 +105,27 @@ int main(int argc, char *argv[]) {
     assert(rd.Clone().ID() == rd.ID());
   }
 
+  {
+    // testing the packed representation of reputation dynamics
+    for (uint64_t id: {0ull, 1ull, 2ull, 728ull, 729ull, 531440ull, 531441ull, 324694920ull, 387420488ull}) {
+      ReputationDynamics rd(id);
+      assert( rd.ID() == id );
+      assert( ReputationDynamics::FromPacked(rd.Packed()).ID() == id );
+      uint64_t x = id;
+      for (size_t i = 0; i < 18; i++) {
+        Reputation rep_d = static_cast<Reputation>(i / 6);
+        Reputation rep_r = static_cast<Reputation>((i/2) % 3);
+        Action act = static_cast<Action>(i % 2);
+        assert( rd.RepAt(rep_d, rep_r, act) == static_cast<Reputation>(x % 3) );  // i-th base-3 digit of the ID
+        assert( ((rd.Packed() >> (2*i)) & 3ull) == x % 3 );
+        x /= 3;
+      }
+    }
+    for (uint64_t id = 0; id < 387420489ull; id += 9973) {
+      assert( ReputationDynamics::IDFromPacked(ReputationDynamics::PackedFromID(id)) == id );
+    }
+  }
+
   {
     // testing IsSecondOrder of reputation dynamics
     ReputationDynamics rd1({
@@ -143,6 +166,36 @@ int main(int argc, char *argv[]) {
     std::cout << "map: " << p.second[0] << ',' << p.second[1] << ',' << p.second[2] << std::endl;
   }
 
+  {
+    // table-driven permutations agree with the slot-by-slot definition
+    for (uint64_t id = 0; id < 387420489ull; id += 99991) {
+      ReputationDynamics rd(id);
+      ActionRule ar(id % 512);
+      uint64_t max_id = id;
+      for (int k = 0; k < ReputationPermutation::NumMaps; k++) {
+        auto map = ReputationPermutation::Map(k);
+        assert( ReputationPermutation::Index(map) == k );
+        ReputationDynamics rd2 = rd.Permute(map);
+        ActionRule ar2 = ar.Permute(map);
+        for (int i = 0; i < 18; i++) {
+          Reputation X = static_cast<Reputation>(i / 6), Y = static_cast<Reputation>((i/2) % 3);
+          Action a = static_cast<Action>(i % 2);
+          Reputation X2 = static_cast<Reputation>(map[i / 6]), Y2 = static_cast<Reputation>(map[(i/2) % 3]);
+          assert( rd2.RepAt(X2, Y2, a) == static_cast<Reputation>(map[static_cast<int>(rd.RepAt(X, Y, a))]) );
+          assert( ar2.ActAt(X2, Y2) == ar.ActAt(X, Y) );
+        }
+        max_id = std::max(max_id, rd2.ID());
+      }
+      auto p = rd.Normalized();
+      assert( p.first.ID() == max_id );
+      assert( rd.Permute(p.second) == p.first );
+      assert( rd.IsNormalized() == (max_id == id) );
+      assert( p.first.IsNormalized() );
+    }
+    assert( ReputationPermutation::Index({0,0,2}) == -1 );
+    assert( ReputationPermutation::Index({1,2,3}) == -1 );
+  }
+
   {
     // when GG=>C is fixed, there are 255 action rules
     for (size_t i = 0; i < 256; i++) {
@@ -213,5 +266,59 @@ int main(int argc, char *argv[]) {
     assert(ids.size() == 32);
   }
 
+  {  // testing NormalizedRDIndex against the brute-force enumeration
+    const uint64_t id_begin = NormalizedRDIndex::NumRD - 300 * NormalizedRDIndex::BlockSize + 100;
+    NormalizedRDIndex index(id_begin, NormalizedRDIndex::NumRD);
+    assert(index.IdBegin() <= id_begin && index.IdBegin() % NormalizedRDIndex::BlockSize == 0);
+    std::vector<uint64_t> expected;
+    for (uint64_t id = index.IdBegin(); id < index.IdEnd(); id++) {
+      if (ReputationDynamics(id).IsNormalized()) { expected.push_back(id); }
+    }
+    assert(index.Size() == expected.size());
+    assert(index.Size() > 0);
+    for (uint64_t i = 0; i < expected.size(); i += 97) {
+      assert(index.Unrank(i) == expected[i]);
+      assert(index.Rank(expected[i]) == i);
+    }
+    assert(index.Rank(index.IdBegin()) == 0);
+    assert(index.Rank(expected.back() + 1) == expected.size());
+    assert(index.Slice(0, index.Size()) == expected);
+    std::vector<uint64_t> part = index.Slice(3, 10);
+    assert(std::equal(part.begin(), part.end(), expected.begin() + 3));
+    assert(index.Slice(index.Size(), 0).empty());
+    // the same index made of the counts of the blocks, e.g., gathered from the processes
+    const uint64_t b0 = index.IdBegin() / NormalizedRDIndex::BlockSize, b_mid = b0 + 100;
+    std::vector<uint64_t> counts = NormalizedRDIndex::CountBlocks(b0, b_mid), counts2 = NormalizedRDIndex::CountBlocks(b_mid, NormalizedRDIndex::NumBlocks);
+    counts.insert(counts.end(), counts2.begin(), counts2.end());
+    const NormalizedRDIndex index2 = NormalizedRDIndex::FromBlockCounts(b0, counts);
+    assert(index2.Size() == index.Size() && index2.IdEnd() == index.IdEnd());
+    assert(index2.Slice(0, index2.Size()) == expected);
+  }
+
+  {  // testing PrescriptionPattern against the prescriptions of strategies
+    const std::string reps = "BNG";
+    for (uint64_t id: std::vector<uint64_t>({0ull, 1234567ull * 512 + 93, 98765432ull * 512 + 400, Strategy::AllC().ID()})) {
+      Strategy s(id);
+      std::vector<std::string> all;
+      for (int i = 0; i < 9; i++) {
+        Reputation X = static_cast<Reputation>(i / 3), Y = static_cast<Reputation>(i % 3);
+        auto p = s.At(X, Y);
+        const std::string xy = {reps[i / 3], reps[i % 3]};
+        const char a = (std::get<0>(p) == Action::C) ? 'c' : 'd', a_not = (a == 'c') ? 'd' : 'c';
+        const char r = reps[static_cast<int>(std::get<1>(p))], r_not = reps[static_cast<int>(std::get<2>(p))];
+        all.push_back(xy + ":" + a + r + ":" + r_not);
+        assert(PrescriptionPattern({xy + ":" + a + r}).Match(s));
+        assert(PrescriptionPattern({xy + ":*" + r}).Match(s));
+        assert(!PrescriptionPattern({xy + ":" + a_not + "*"}).Match(s));
+        assert(PrescriptionPattern({xy + a_not + ":" + r_not}).Match(s));
+        assert(!PrescriptionPattern({xy + ":" + a + "[" + reps.substr(0, 3).erase(reps.find(r), 1) + "]"}).Match(s));
+        assert(PrescriptionPattern({xy + ":**:[" + std::string(1, r_not) + "]"}).Match(s));
+      }
+      assert(PrescriptionPattern(all).Match(s));
+      assert(PrescriptionPattern({}).Match(s));
+      assert(!PrescriptionPattern({"GG:cG", "GG:dG"}).Match(s));
+    }
+  }
+
   return 0;
 }